@@ -0,0 +1,268 @@
+#ifndef __ACTION_VALUES_H__
+#define __ACTION_VALUES_H__
+
+#include <linear_options/SparseFeatures.hh>
+#include <stdint.h>
+#include <cstddef>
+#include <stdexcept>
+#include <Eigen/Core>
+
+namespace rl {
+
+/**
+ * Precision of the weights evaluated by the greedy policy of an option
+ */
+enum policy_precision {
+    DOUBLE_POLICY,
+    FLOAT_POLICY,
+    INT8_POLICY
+};
+
+/**
+ * Single precision copy of an action-value weight matrix, laid out for
+ * greedy action selection only. Every feature owns one row holding the
+ * weights of all the actions, padded with zeros to a multiple of PADDING
+ * so that a row fills whole SIMD registers. A decision reads the row of
+ * every active feature once and accumulates all the action values together.
+ *
+ * Other linear functions of the features, such as the value of an option,
+ * can follow the actions in the matrix and are then evaluated along,
+ * often in the padding.
+ */
+struct padded_action_values
+{
+    // Number of floats in a 128 bits SIMD register
+    static const int PADDING = 4;
+
+    // Largest number of actions, so that the action values live on the stack
+    static const int MAX_ACTIONS = 32;
+
+    typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> weight_matrix;
+    typedef Eigen::Matrix<float, 1, Eigen::Dynamic, Eigen::RowMajor, 1, MAX_ACTIONS> value_vector;
+
+    padded_action_values() : numActions(0) {};
+
+    /**
+     * @param W The action-value weights, one column per action
+     */
+    padded_action_values(const Eigen::MatrixXd& W) { assign(W); }
+
+    /**
+     * @param W The action-value weights, one column per action
+     * @param actions The number of leading columns of W which are actions, all of them if negative
+     * @throw std::invalid_argument If W has more than MAX_ACTIONS columns once padded
+     */
+    void assign(const Eigen::MatrixXd& W, int actions = -1)
+    {
+        int padded = (W.cols() + PADDING - 1)/PADDING*PADDING;
+        if (padded > MAX_ACTIONS) {
+            throw std::invalid_argument("Too many actions for the padded action values");
+        }
+        numActions = actions < 0 ? W.cols() : actions;
+        weights = weight_matrix::Zero(W.rows(), padded);
+        weights.leftCols(W.cols()) = W.cast<float>();
+    }
+
+    /**
+     * @param phi The current state
+     * @param q Set to the value of every column
+     */
+    void evaluate(const Eigen::VectorXd& phi, value_vector& q) const
+    {
+        q = value_vector::Zero(weights.cols());
+        for (int j = 0; j < phi.size(); j++) {
+            if (phi(j) != 0) {
+                q += float(phi(j))*weights.row(j);
+            }
+        }
+    }
+
+    /**
+     * @param phi The active features of the current state
+     * @param q Set to the value of every column
+     */
+    void evaluate(const sparse_features& phi, value_vector& q) const
+    {
+        q = value_vector::Zero(weights.cols());
+        for (unsigned k = 0; k < phi.indices.size(); k++) {
+            accumulate(phi.values[k], weights.row(phi.indices[k]).data(), q);
+        }
+    }
+
+    /**
+     * @param phi The active binary features of the current state
+     * @param q Set to the value of every column
+     */
+    void evaluate(const binary_features& phi, value_vector& q) const
+    {
+        q = value_vector::Zero(weights.cols());
+        for (unsigned k = 0; k < phi.indices.size(); k++) {
+            accumulate(1, weights.row(phi.indices[k]).data(), q);
+        }
+    }
+
+    /**
+     * @param phi The current state, dense, sparse or binary
+     * @return The action of maximum value
+     */
+    template<class Features>
+    int greedy(const Features& phi) const
+    {
+        value_vector q;
+        evaluate(phi, q);
+        return argmax(q, numActions);
+    }
+
+    /**
+     * @return The size of the weights in bytes
+     */
+    size_t bytes() const { return weights.size()*sizeof(float); }
+
+    /**
+     * @return The index of the largest of the first n values
+     */
+    static int argmax(const value_vector& q, int n)
+    {
+        int action = 0;
+        q.head(n).maxCoeff(&action);
+        return action;
+    }
+
+    // Number of actions, without the padding and the other functions
+    int numActions;
+
+    weight_matrix weights;
+
+private:
+    typedef Eigen::Array<float, PADDING, 1> lanes;
+
+    /**
+     * q += v*row, one SIMD register at a time
+     */
+    static void accumulate(float v, const float* row, value_vector& q)
+    {
+        for (int c = 0; c < q.size(); c += PADDING) {
+            lanes::Map(q.data() + c) += v*lanes::Map(row + c);
+        }
+    }
+};
+
+/**
+ * 8 bits copy of an action-value weight matrix, in the layout of
+ * padded_action_values. The weights of every column are quantized
+ * symmetrically with a scale of their own, max|W_a|/127, as the action
+ * values of different actions may differ by orders of magnitude.
+ *
+ * A row of PADDING weights is one 32 bits load widened to a full SIMD
+ * register. The rows of binary features are summed exactly in 32 bits
+ * integers, and those of weighted features in floats, before the scales
+ * are applied once per decision.
+ */
+struct quantized_action_values
+{
+    static const int PADDING = padded_action_values::PADDING;
+    static const int MAX_ACTIONS = padded_action_values::MAX_ACTIONS;
+
+    typedef Eigen::Matrix<int8_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> weight_matrix;
+    typedef Eigen::Matrix<int32_t, 1, Eigen::Dynamic, Eigen::RowMajor, 1, MAX_ACTIONS> sum_vector;
+    typedef padded_action_values::value_vector value_vector;
+
+    quantized_action_values() : numActions(0) {};
+
+    /**
+     * @param W The action-value weights, one column per action
+     */
+    quantized_action_values(const Eigen::MatrixXd& W) { assign(W); }
+
+    /**
+     * @param W The action-value weights, one column per action
+     * @param actions The number of leading columns of W which are actions, all of them if negative
+     * @throw std::invalid_argument If W has more than MAX_ACTIONS columns once padded
+     */
+    void assign(const Eigen::MatrixXd& W, int actions = -1)
+    {
+        int padded = (W.cols() + PADDING - 1)/PADDING*PADDING;
+        if (padded > MAX_ACTIONS) {
+            throw std::invalid_argument("Too many actions for the padded action values");
+        }
+        numActions = actions < 0 ? W.cols() : actions;
+        weights = weight_matrix::Zero(W.rows(), padded);
+        scales = value_vector::Zero(padded);
+        for (int a = 0; a < W.cols(); a++) {
+            double largest = W.rows() ? W.col(a).cwiseAbs().maxCoeff() : 0;
+            double scale = largest > 0 ? largest/127 : 1;
+            weights.col(a) = (W.col(a)/scale).array().round().cwiseMax(-127).cwiseMin(127).cast<int8_t>().matrix();
+            scales(a) = scale;
+        }
+    }
+
+    /**
+     * @param phi The current state
+     * @param q Set to the value of every column
+     */
+    void evaluate(const Eigen::VectorXd& phi, value_vector& q) const
+    {
+        q = value_vector::Zero(weights.cols());
+        for (int j = 0; j < phi.size(); j++) {
+            if (phi(j) != 0) {
+                q += float(phi(j))*weights.row(j).cast<float>();
+            }
+        }
+        q = q.cwiseProduct(scales);
+    }
+
+    /**
+     * @param phi The active features of the current state
+     * @param q Set to the value of every column
+     */
+    void evaluate(const sparse_features& phi, value_vector& q) const
+    {
+        q = value_vector::Zero(weights.cols());
+        for (unsigned k = 0; k < phi.indices.size(); k++) {
+            q += float(phi.values[k])*weights.row(phi.indices[k]).cast<float>();
+        }
+        q = q.cwiseProduct(scales);
+    }
+
+    /**
+     * @param phi The active binary features of the current state
+     * @param q Set to the value of every column
+     */
+    void evaluate(const binary_features& phi, value_vector& q) const
+    {
+        sum_vector sum = sum_vector::Zero(weights.cols());
+        for (unsigned k = 0; k < phi.indices.size(); k++) {
+            sum += weights.row(phi.indices[k]).cast<int32_t>();
+        }
+        q = sum.cast<float>().cwiseProduct(scales);
+    }
+
+    /**
+     * @param phi The current state, dense, sparse or binary
+     * @return The action of maximum value
+     */
+    template<class Features>
+    int greedy(const Features& phi) const
+    {
+        value_vector q;
+        evaluate(phi, q);
+        return padded_action_values::argmax(q, numActions);
+    }
+
+    /**
+     * @return The size of the weights and scales in bytes
+     */
+    size_t bytes() const { return weights.size()*sizeof(int8_t) + scales.size()*sizeof(float); }
+
+    // Number of actions, without the padding and the other functions
+    int numActions;
+
+    weight_matrix weights;
+
+    // Scale of every column
+    value_vector scales;
+};
+
+} // namespace rl
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef __BINARY_ARCHIVE_H__
+#define __BINARY_ARCHIVE_H__
+
+#include <Eigen/Core>
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace rl {
+
+/**
+ * A binary archive is a header, followed by a table describing every
+ * array, followed by the arrays themselves as raw column-major doubles
+ * in native byte order. Every array starts on a BINARY_ALIGNMENT boundary
+ * so that it can be used in place once the file is mapped in memory.
+ */
+static const char BINARY_MAGIC[8] = {'L', 'O', 'P', 'T', 'B', 'I', 'N', '\0'};
+static const uint32_t BINARY_VERSION = 1;
+static const uint64_t BINARY_ALIGNMENT = 64;
+
+// What the arrays of an archive represent
+enum BINARY_KIND {
+    // One n x numActions matrix
+    BINARY_POLICY,
+    // Per option, the n x numActions policy then the n x 1 theta
+    BINARY_OPTIONS,
+    // Per option, the n x n transition model F then the n x 1 reward model b
+    BINARY_OPTION_MODELS,
+    // Per option, the n x k factors U and V of F = U*V^T then the n x 1 reward model b
+    BINARY_FACTORED_OPTION_MODELS
+};
+
+struct binary_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t kind;
+    uint64_t count;
+};
+
+struct binary_entry
+{
+    uint64_t rows;
+    uint64_t cols;
+    // Position of the first element, from the beginning of the file
+    uint64_t offset;
+};
+
+/**
+ * A column-major array of doubles to be written in an archive.
+ * The data is not owned.
+ */
+struct binary_array
+{
+    binary_array(const Eigen::MatrixXd& m) : rows(m.rows()), cols(m.cols()), data(m.data()) {};
+    binary_array(const Eigen::VectorXd& v) : rows(v.size()), cols(1), data(v.data()) {};
+
+    uint64_t rows;
+    uint64_t cols;
+    const double* data;
+};
+
+/**
+ * Write arrays to a binary archive
+ * @param filename The path of the archive
+ * @param kind One of BINARY_KIND
+ * @param arrays The arrays to write, in order
+ * @throw std::runtime_error If the archive cannot be written
+ */
+void saveBinary(const std::string& filename, uint32_t kind, const std::vector<binary_array>& arrays);
+
+/**
+ * @param filename The path of a file
+ * @return true if the file starts with the magic number of a binary archive
+ */
+bool isBinaryArchive(const std::string& filename);
+
+/**
+ * A binary archive mapped read-only in memory. The matrices returned
+ * point directly into the mapping: nothing is parsed or copied, and
+ * they remain valid for the lifetime of this object.
+ */
+class MappedArchive
+{
+public:
+    /**
+     * @param filename The path of the archive
+     * @throw std::runtime_error If the file cannot be mapped or is not a valid archive
+     */
+    MappedArchive(const std::string& filename);
+    ~MappedArchive();
+
+    /**
+     * @return One of BINARY_KIND
+     */
+    uint32_t kind() const { return header->kind; }
+
+    /**
+     * @return The number of arrays in the archive
+     */
+    unsigned size() const { return header->count; }
+
+    /**
+     * @param i Index of the array
+     * @return A view of the i-th array
+     * @throw std::out_of_range If there is no i-th array
+     */
+    Eigen::Map<const Eigen::MatrixXd> matrix(unsigned i) const;
+
+    /**
+     * @param i Index of the array, which must have a single column
+     * @return A view of the i-th array
+     * @throw std::out_of_range If there is no i-th array
+     */
+    Eigen::Map<const Eigen::VectorXd> vector(unsigned i) const;
+
+private:
+    MappedArchive(const MappedArchive&);
+    MappedArchive& operator=(const MappedArchive&);
+
+    void* data;
+    size_t length;
+
+    const binary_header* header;
+    const binary_entry* entries;
+};
+
+} // namespace rl
+
+#endif
@@ -0,0 +1,289 @@
+#ifndef __COMPACT_ABSTRACTION_H__
+#define __COMPACT_ABSTRACTION_H__
+
+#include <linear_options/StateAbstraction.hh>
+#include <linear_options/Option.hh>
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+#include <Eigen/Core>
+
+namespace rl {
+
+/**
+ * The features of another sparse abstraction, without those which never
+ * activate over a sweep of the reachable states, such as the centers
+ * buried in walls, and with a single representative of the features which
+ * take the same value in every state of the sweep, such as the centers
+ * which only differ by their heading when the heading is ignored.
+ *
+ * The remaining features keep their relative order. The first features
+ * can be exempted from the compaction, so that the indices the terminations
+ * rely on are unchanged. Since every weight vector over the original
+ * features has an equivalent over the compact ones, the policies and
+ * option models learnt before the compaction can be converted with
+ * compactWeights() and compact().
+ *
+ * The duplicates are found by a fingerprint of their activations over
+ * the sweep, and confirmed by a second pass over it. The projection
+ * is safe to share between threads when the wrapped one is.
+ */
+struct compact_abstraction : public sparse_state_abstraction
+{
+    /**
+     * @param abstraction The abstraction to compact, which must outlive this one
+     * @param states The sweep of reachable states, one per column
+     * @param keep The number of leading features kept as they are
+     */
+    compact_abstraction(sparse_state_abstraction& abstraction, const Eigen::MatrixXd& states, int keep = 0) :
+        abstraction(abstraction)
+    {
+        const int n = abstraction.length();
+        sparse_features active(n);
+
+        // Number of activations and fingerprint of every feature over the sweep
+        std::vector<unsigned> counts(n, 0);
+        std::vector<fingerprint> fingerprints(n);
+        for (int j = 0; j < states.cols(); j++) {
+            abstraction.project(states.col(j), active);
+            for (unsigned k = 0; k < active.indices.size(); k++) {
+                int i = active.indices[k];
+                counts[i] += 1;
+                fingerprints[i].add(j, active.values[k]);
+            }
+        }
+
+        // Group the features activated with the same fingerprint
+        std::vector<int> order;
+        for (int i = keep; i < n; i++) {
+            if (counts[i]) {
+                order.push_back(i);
+            }
+        }
+        std::stable_sort(order.begin(), order.end(), by_fingerprint(fingerprints));
+
+        representative.resize(n);
+        for (int i = 0; i < n; i++) {
+            representative[i] = (i < keep || counts[i]) ? i : -1;
+        }
+        for (unsigned k = 1; k < order.size(); k++) {
+            const fingerprint& a = fingerprints[order[k - 1]];
+            const fingerprint& b = fingerprints[order[k]];
+            if (a.first == b.first && a.second == b.second && counts[order[k - 1]] == counts[order[k]]) {
+                representative[order[k]] = representative[order[k - 1]];
+            }
+        }
+
+        confirm(states);
+
+        // Indices of the representatives in the compact space
+        index.assign(n, -1);
+        int m = 0;
+        for (int i = 0; i < n; i++) {
+            if (representative[i] == i) {
+                index[i] = m++;
+            }
+        }
+        compactLength = m;
+    }
+
+    /**
+     * @param s The input state
+     * @param phi The active features, in the compact space
+     */
+    void project(const Eigen::VectorXd& s, sparse_features& phi)
+    {
+        abstraction.project(s, phi);
+
+        // Remap in place, as the features only ever move down the list
+        unsigned m = 0;
+        for (unsigned k = 0; k < phi.indices.size(); k++) {
+            int i = index[phi.indices[k]];
+            if (i >= 0) {
+                phi.indices[m] = i;
+                phi.values[m] = phi.values[k];
+                m += 1;
+            }
+        }
+        phi.indices.resize(m);
+        phi.values.resize(m);
+        phi.dimension = compactLength;
+    }
+
+    /**
+     * @Override
+     */
+    void reset() { abstraction.reset(); }
+
+    int length() { return compactLength; }
+
+    /**
+     * @param i Index of an original feature
+     * @return Its index in the compact space, or -1 if it was dropped
+     * or merged into another feature
+     */
+    int compactIndex(int i) const { return index[i]; }
+
+    /**
+     * Weights of linear functions of the features, such as the action
+     * values or the option values, for the same functions of the compact
+     * features: the rows of merged features are summed, and the rows of
+     * dropped features are discarded.
+     * @param W The weights over the original features, one function per column
+     * @return The weights over the compact features
+     */
+    Eigen::MatrixXd compactWeights(const Eigen::MatrixXd& W) const
+    {
+        Eigen::MatrixXd out = Eigen::MatrixXd::Zero(compactLength, W.cols());
+        for (unsigned i = 0; i < representative.size(); i++) {
+            if (representative[i] >= 0) {
+                out.row(index[representative[i]]) += W.row(i);
+            }
+        }
+        return out;
+    }
+
+    /**
+     * Predictions of the features, such as the expected features at
+     * termination, restricted to the compact features: the rows of the
+     * representatives are kept.
+     * @param W The predictions of the original features, one per row
+     * @return The predictions of the compact features
+     */
+    Eigen::MatrixXd compactTargets(const Eigen::MatrixXd& W) const
+    {
+        Eigen::MatrixXd out(compactLength, W.cols());
+        for (unsigned i = 0; i < representative.size(); i++) {
+            if (index[i] >= 0) {
+                out.row(index[i]) = W.row(i);
+            }
+        }
+        return out;
+    }
+
+    /**
+     * Convert a model over the original features in place
+     */
+    void compact(LinearOptionModel& model) const
+    {
+        if (model.factored()) {
+            // F = U*V^T: U predicts the features, V weighs them
+            model.U = compactTargets(model.U);
+            model.V = compactWeights(model.V);
+        } else {
+            model.F = compactTargets(compactWeights(model.F.transpose()).transpose());
+        }
+        model.b = compactWeights(model.b);
+    }
+
+    /**
+     * Convert an option over the original features in place
+     */
+    void compact(LinearOption& option) const
+    {
+        option.setActionValueThetas(compactWeights(option.getActionValueThetas()));
+        if (option.theta.size()) {
+            option.theta = compactWeights(option.theta);
+        }
+    }
+
+private:
+    /**
+     * Two independent 64 bits hashes of the (state, value) pairs
+     * for which a feature is active, in the order of the sweep
+     */
+    struct fingerprint : public std::pair<uint64_t, uint64_t>
+    {
+        fingerprint() : std::pair<uint64_t, uint64_t>(0, 0) {};
+
+        void add(uint64_t j, double v)
+        {
+            uint64_t bits;
+            std::memcpy(&bits, &v, sizeof(bits));
+            first = mix(first ^ mix(j*0x9e3779b97f4a7c15ULL + bits));
+            second = mix(second + mix(bits ^ (j << 32 | j >> 32)) + 0x632be59bd9b4e019ULL);
+        }
+
+        static uint64_t mix(uint64_t x)
+        {
+            x ^= x >> 33;
+            x *= 0xff51afd7ed558ccdULL;
+            x ^= x >> 33;
+            x *= 0xc4ceb9fe1a85ec53ULL;
+            x ^= x >> 33;
+            return x;
+        }
+    };
+
+    struct by_fingerprint
+    {
+        by_fingerprint(const std::vector<fingerprint>& fingerprints) : fingerprints(fingerprints) {};
+        bool operator()(int i, int j) const { return fingerprints[i] < fingerprints[j]; }
+        const std::vector<fingerprint>& fingerprints;
+    };
+
+    /**
+     * Check over the sweep that every feature merged into a representative
+     * is active in the same states with the same values. The features
+     * of a group for which this fails are kept apart.
+     */
+    void confirm(const Eigen::MatrixXd& states)
+    {
+        const int n = representative.size();
+        sparse_features active(n);
+
+        std::vector<int> groupSize(n, 0);
+        for (int i = 0; i < n; i++) {
+            if (representative[i] >= 0) {
+                groupSize[representative[i]] += 1;
+            }
+        }
+
+        std::vector<bool> failed(n, false);
+        std::vector<int> seen(n, 0);
+        std::vector<double> value(n, 0);
+        for (int j = 0; j < states.cols(); j++) {
+            abstraction.project(states.col(j), active);
+            for (unsigned k = 0; k < active.indices.size(); k++) {
+                int r = representative[active.indices[k]];
+                if (seen[r] == 0) {
+                    value[r] = active.values[k];
+                } else if (value[r] != active.values[k]) {
+                    failed[r] = true;
+                }
+                seen[r] += 1;
+            }
+            for (unsigned k = 0; k < active.indices.size(); k++) {
+                int r = representative[active.indices[k]];
+                if (seen[r] != groupSize[r]) {
+                    failed[r] = true;
+                }
+            }
+            for (unsigned k = 0; k < active.indices.size(); k++) {
+                seen[representative[active.indices[k]]] = 0;
+            }
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (representative[i] >= 0 && failed[representative[i]]) {
+                representative[i] = i;
+            }
+        }
+    }
+
+    sparse_state_abstraction& abstraction;
+
+    // Original feature standing for every feature, -1 if dropped
+    std::vector<int> representative;
+
+    // Index in the compact space of the representatives, -1 for the others
+    std::vector<int> index;
+
+    int compactLength;
+};
+
+} // namespace rl
+
+#endif
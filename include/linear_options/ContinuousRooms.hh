@@ -4,14 +4,33 @@
 #include <rl_common/core.hh>
 #include <opencv/cv.h>
 
+#include <memory>
+
+struct RoomsMap;
+struct ConfigurationSpace;
+
 struct ContinuousRooms : public Environment 
 {
   ContinuousRooms(const std::string& map, double robotRadius, bool randomizeInitialPosition = false, double safetyMargin = 0, Random rng = Random());
+
+  /**
+   * @param map The decoded layout of the world, shared with other environments
+   */
+  ContinuousRooms(std::shared_ptr<const RoomsMap> map, double robotRadius, bool randomizeInitialPosition = false, double safetyMargin = 0, Random rng = Random());
+
+  /**
+   * @param map The decoded layout of the world, shared with other environments
+   * @param space Where the robot can be in this map, shared with other environments
+   */
+  ContinuousRooms(std::shared_ptr<const RoomsMap> map, std::shared_ptr<const ConfigurationSpace> space, bool randomizeInitialPosition = false, Random rng = Random());
    
   enum PRIMITIVE_ACTIONS { FORWARD, LEFT, RIGHT, NUM_ACTIONS };
 
   enum ROOM_COLORS { GREEN, BLUE, PURPLE, YELLOW, NUM_COLORS };
 
+  // Labels of the map pixels which are not the floor of a room
+  enum MAP_LABELS { WALL = NUM_COLORS, UNKNOWN, NUM_LABELS };
+
 
   static const double NEGATIVE_REWARD_EXTRA_STEP = -0.01;
 
@@ -62,9 +81,11 @@ struct ContinuousRooms : public Environment
    */
   virtual void getMinMaxReward(float *minR, float *maxR);
 
-    // RGB image corresponding to the layout of the world
-    // FIXME make private
-    cv::Mat map;
+  /**
+   * @return The layout of the world
+   */
+  const RoomsMap& getMap() const { return *map; }
+
 protected:
    /**
     * @param x 
@@ -74,17 +95,16 @@ protected:
    bool isCollisionFree(double x, double y); 
 
 private:
-    std::vector<int> circularROI;
-
-    double robotRadius;
-
     /**
-     * Return the boundaries of a circular region of interest
-     * Used for collision detection
-     * @param R radius
-     * @param circularROI output vector
+     * Shared initialization for both constructors
      */
-    void getCircularROI(int R, std::vector<int>& circularROI);
+    void init();
+
+    // Layout of the world, one label per pixel
+    std::shared_ptr<const RoomsMap> map;
+
+    // Where the robot can be, given its radius and safety margin
+    std::shared_ptr<const ConfigurationSpace> space;
 
     /**
      * Fill the internal state vector with the relevant state information
@@ -107,7 +127,6 @@ private:
     bool terminated;
 
     bool randomPosition;
-    double safetyMargin;
     Random rng;
 
     std::vector<float> currentState;
@@ -115,4 +134,80 @@ private:
     unsigned minimaSteps;
 };
 
+/**
+ * The layout of the world decoded once from an RGB image into a single
+ * byte per pixel, holding either one of the ROOM_COLORS or one of the
+ * MAP_LABELS. It is never modified after construction, so a single
+ * instance can be shared by many environments.
+ */
+struct RoomsMap
+{
+    /**
+     * @param filename The RGB image corresponding to the layout of the world
+     */
+    RoomsMap(const std::string& filename);
+
+    /**
+     * @return The label of the pixel at (x, y)
+     */
+    uchar label(int x, int y) const { return labels.at<uchar>(y, x); }
+
+    int width() const { return labels.cols; }
+
+    int height() const { return labels.rows; }
+
+    // One label per pixel
+    cv::Mat labels;
+};
+
+/**
+ * The positions that the center of a circular robot can take in a map.
+ * Like the map, it is never modified after construction.
+ */
+struct ConfigurationSpace
+{
+    /**
+     * @param map The layout of the world
+     * @param R The radius of the robot, including any safety margin
+     */
+    ConfigurationSpace(const RoomsMap& map, int R);
+
+    /**
+     * @return true if the robot can stand at (x, y)
+     */
+    bool isFree(double x, double y) const
+    {
+        int col = std::floor(x);
+        int row = std::floor(y);
+
+        // Check boundary conditions
+        if (col < 0 || row < 0 || col >= occupancy.cols || row >= occupancy.rows) {
+            return false;
+        }
+
+        return occupancy.at<uchar>(row, col) == 0;
+    }
+
+    /**
+     * Draw a position uniformly over the free space: 
+     * pick a free cell, then a point within it
+     * @param rng The random generator
+     * @param x Set to the abscissa
+     * @param y Set to the ordinate
+     */
+    void sample(Random& rng, double& x, double& y) const
+    {
+        const cv::Point& cell = freeCells[rng.uniformDiscrete(0, freeCells.size()-1)];
+        x = cell.x + rng.uniform();
+        y = cell.y + rng.uniform();
+    }
+
+    // Non-zero where the robot center cannot be,
+    // i.e. the walls dilated by the robot radius and safety margin
+    cv::Mat occupancy;
+
+    // Cells where the robot can be placed
+    std::vector<cv::Point> freeCells;
+};
+
 #endif
@@ -0,0 +1,136 @@
+#ifndef __CONTINUOUS_ROOMS_BATCH_H__
+#define __CONTINUOUS_ROOMS_BATCH_H__
+
+#include <linear_options/ContinuousRooms.hh>
+
+#include <memory>
+#include <vector>
+#include <Eigen/Core>
+
+/**
+ * N robots in the world of ContinuousRooms, with the same dynamics and
+ * rewards, stepped together by a single call. The state of the robots is
+ * kept as a structure of arrays and every step is a sequence of branch-free 
+ * passes over them: the masked motion model, a gathered lookup of the 
+ * configuration space for the collisions, a gathered lookup of the labels
+ * for the goal and the colors sensed, the minima and termination flags, and
+ * finally the reset of the compacted list of terminated robots. A robot 
+ * reaching a terminal state is reset right after its reward is recorded, 
+ * and flagged as terminated until the next step.
+ *
+ * Every robot draws its noise and initial positions from its own random
+ * stream, so robot i follows the same trajectory as a ContinuousRooms 
+ * environment seeded like stream i, whatever the other robots do.
+ */
+struct ContinuousRoomsBatch
+{
+    /**
+     * @param map The layout of the world
+     * @param size The number N of robots
+     */
+    ContinuousRoomsBatch(std::shared_ptr<const RoomsMap> map, unsigned size, double robotRadius, bool randomizeInitialPosition = false, double safetyMargin = 0, Random rng = Random());
+
+    /**
+     * @param map The layout of the world
+     * @param space Where the robots can be in this map, shared with other environments
+     * @param size The number N of robots
+     */
+    ContinuousRoomsBatch(std::shared_ptr<const RoomsMap> map, std::shared_ptr<const ConfigurationSpace> space, unsigned size, bool randomizeInitialPosition = false, Random rng = Random());
+
+    /**
+     * @param map The layout of the world
+     * @param space Where the robots can be in this map, shared with other environments
+     * @param streams One random stream per robot
+     */
+    ContinuousRoomsBatch(std::shared_ptr<const RoomsMap> map, std::shared_ptr<const ConfigurationSpace> space, const std::vector<Random>& streams, bool randomizeInitialPosition = false);
+
+    /**
+     * Apply one action to every robot
+     * @param actions One of ContinuousRooms::PRIMITIVE_ACTIONS per robot
+     * @param rewards Set to the reward of every robot
+     */
+    void apply(const std::vector<int>& actions, std::vector<float>& rewards);
+
+    /**
+     * Start a new episode for every robot
+     */
+    void reset();
+
+    /**
+     * Start a new episode for one robot
+     * @param i Index of the robot
+     */
+    void reset(unsigned i);
+
+    /**
+     * @param i Index of the robot
+     * @param s Set to the state vector of robot i, as in ContinuousRooms::sensation
+     */
+    void sensation(unsigned i, std::vector<float>& s) const;
+
+    /**
+     * @param S Resized to 7 x N if needed and set to the state vectors
+     * of every robot, one per column, as expected by state_abstraction::projectBatch
+     */
+    void sensations(Eigen::MatrixXd& S) const;
+
+    /**
+     * @return The number N of robots
+     */
+    unsigned size() const { return x.size(); }
+
+    // Current poses
+    Eigen::ArrayXd x;
+    Eigen::ArrayXd y;
+    Eigen::ArrayXd psi;
+
+    // Positions before the last step
+    Eigen::ArrayXd lastX;
+    Eigen::ArrayXd lastY;
+
+    // Number of steps for which every robot has barely moved
+    std::vector<unsigned> minimaSteps;
+
+    // Non-zero for the robots whose episode ended in the last step
+    std::vector<uchar> terminated;
+
+    // Last color sensed by every robot, NUM_COLORS if none yet
+    std::vector<uchar> colors;
+
+private:
+    /**
+     * Seed one stream per robot from rng
+     */
+    static std::vector<Random> split(Random rng, unsigned size);
+
+    /**
+     * Read the label under every robot.
+     * The last color sensed is kept over walls and unknown colors.
+     */
+    void sense();
+
+    std::shared_ptr<const RoomsMap> map;
+    std::shared_ptr<const ConfigurationSpace> space;
+
+    bool randomPosition;
+    std::vector<Random> streams;
+
+    // Label of the pixel under every robot
+    std::vector<uchar> labels;
+
+    // Per step masks of the robots at the goal, moving forward and colliding
+    std::vector<uchar> goal;
+    std::vector<uchar> forward;
+    std::vector<uchar> blocked;
+
+    // Candidate positions of the FORWARD action and their noise
+    Eigen::ArrayXd xPrime;
+    Eigen::ArrayXd yPrime;
+    Eigen::ArrayXd noiseX;
+    Eigen::ArrayXd noiseY;
+
+    // Indices of the robots to reset at the end of the step
+    std::vector<unsigned> resets;
+};
+
+#endif
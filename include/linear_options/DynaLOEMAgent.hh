@@ -2,7 +2,15 @@
 #define __DYNA_LOEM_AGENT_H__
 
 #include <linear_options/LOEMAgent.hh>
-#include <map>
+#include <linear_options/OptionRegistry.hh>
+#include <linear_options/PlanningBuffer.hh>
+#include <linear_options/SweepQueue.hh>
+#include <linear_options/LSTDOptionModelLearner.hh>
+
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 namespace rl {
 
@@ -15,8 +23,16 @@ namespace rl {
 class DynaLOEMAgent : public LOEMAgent
 {
 public:
-     DynaLOEMAgent(unsigned numActions, double alpha, double epsilon, double gamma, rl::state_abstraction& stateAbstraction, const std::string& optionsFile, const std::string& optionModelsFile, Random rng = Random()); 
-    virtual ~DynaLOEMAgent() {};
+    /**
+     * @param modelRank If non-zero, the transition models are kept factored 
+     * with this rank. Dense models are factorized as they are loaded.
+     */
+     DynaLOEMAgent(unsigned numActions, double alpha, double epsilon, double gamma, rl::state_abstraction& stateAbstraction, const std::string& optionsFile, const std::string& optionModelsFile, Random rng = Random(), unsigned modelRank = 0); 
+
+    /**
+     * Stop the planning threads
+     */
+    virtual ~DynaLOEMAgent();
 
     /**
      * @Override
@@ -38,69 +54,399 @@ public:
      */
     void setDebug(bool d);
 
+    /**
+     * Besides the planning update at the current state, follow every real 
+     * step with a budget of planning updates at states drawn uniformly from
+     * the last ones visited. These updates can run on background threads
+     * while the agent keeps acting: each thread then locks one option at a
+     * time, and a real step locks all of them.
+     * @param budget The number K of planning updates per real step, 0 to disable
+     * @param threads The number of planning threads, 0 to plan within next_action
+     * @param capacity The number of visited states to draw from
+     */
+    void setPlanning(unsigned budget, unsigned threads = 0, unsigned capacity = 10000);
+
+    /**
+     * Plan by prioritized sweeping over the features instead. A planning
+     * update at feature j is the planning update at the unit vector e_j, 
+     * and costs one column of every transition model. The features active
+     * in a real step are queued by the size of the planning change there.
+     * After an update at j, every feature i is queued by the change at j 
+     * times F(j, i), since its planning target depends on the value of j.
+     * Planning stops early once no feature is above the threshold.
+     * @param budget The largest number K of planning updates per real step
+     * @param threshold The smallest change worth planning for
+     * @param threads The number of planning threads, 0 to plan within next_action
+     */
+    void setPrioritizedPlanning(unsigned budget, double threshold = 1e-4, unsigned threads = 0);
+
+    /**
+     * Learn the dense option models F and b by incremental least-squares 
+     * (LSTD) rather than by the gradient rule, starting from the current
+     * models. Each consistent option then costs O(n^2) per step and keeps
+     * an extra n x n matrix, but the models no longer depend on alpha.
+     * @param regularization The weight of the current models as a prior
+     * @param record Keep the transitions for solveOptionModels()
+     */
+    void setLeastSquaresModels(double regularization = 1e-2, bool record = false);
+
+    /**
+     * Re-solve the least-squares models from the recorded transitions
+     * @throw std::logic_error If the transitions are not recorded
+     */
+    void solveOptionModels();
+
+    /**
+     * @Override
+     * The weights learnt by the agent are written back into the options first.
+     */
+    void saveOptions(const std::string& filename)
+    {
+        auto guards = lockOptions();
+        registry.store();
+        LOEMAgent::saveOptions(filename);
+    }
+
+    /**
+     * @Override
+     */
+    void saveBinaryOptions(const std::string& filename)
+    {
+        auto guards = lockOptions();
+        registry.store();
+        LOEMAgent::saveBinaryOptions(filename);
+    }
+
 protected:    
     /**
-     * Return the action with the highest return max_o Q(s, O)
+     * Return the option with the highest return max_o Q(s, O)
      * @param phi The n-dimensional projection of a state
-     * @param the LinearOption of maximum value
+     * @param the id of the option of maximum value
      */
-    LinearOption* getBestOption(const Eigen::VectorXd& phi);
+    template<class Features>
+    option_id getBestOption(const Features& phi);
 
-    // We maintain a model of the transition and reward dynamics for every option.
-    std::map<LinearOption*, LinearOptionModel*> optionModels;
+    // The options, their value function weights and the model of the 
+    // transition and reward dynamics we maintain for every option.
+    // The ids are the positions in options.
+    OptionRegistry registry;
 
     void saveOptionModels(const std::string& filename) 
     {
+        auto guards = lockOptions();
         std::ofstream file(filename); 
         boost::archive::text_oarchive oa(file);
-        for (auto it = options.begin(); it != options.end(); it++) {
-            oa << optionModels[(*it)];
+        for (option_id i = 0; i < registry.size(); i++) {
+            LinearOptionModel* model = &registry.model(i);
+            oa << model;
+        }
+    }
+
+    void saveBinaryOptionModels(const std::string& filename) 
+    {
+        auto guards = lockOptions();
+
+        // The models are either all dense or all factored
+        bool factored = registry.size() > 0 && registry.model(0).factored();
+
+        std::vector<binary_array> arrays;
+        for (option_id i = 0; i < registry.size(); i++) {
+            LinearOptionModel* model = &registry.model(i);
+            if (factored) {
+                arrays.push_back(binary_array(model->U));
+                arrays.push_back(binary_array(model->V));
+            } else {
+                arrays.push_back(binary_array(model->F));
+            }
+            arrays.push_back(binary_array(model->b));
         }
+        saveBinary(filename, factored ? BINARY_FACTORED_OPTION_MODELS : BINARY_OPTION_MODELS, arrays);
     }
 
+    // Accepts both the text and the binary format.
+    // Throws std::runtime_error if the models are not over the features of the options.
     void loadOptionModels(const std::string& filename)
     {
+        if (isBinaryArchive(filename)) {
+            MappedArchive archive(filename);
+            bool factored = archive.kind() == BINARY_FACTORED_OPTION_MODELS;
+            unsigned stride = factored ? 3 : 2;
+            if ((archive.kind() != BINARY_OPTION_MODELS && !factored) || archive.size() != stride*registry.size()) {
+                throw std::runtime_error("Not an option models archive for these options " + filename);
+            }
+
+            // Every model is over the features of the options
+            const int n = registry.getThetas().rows();
+            for (option_id i = 0; i < registry.size(); i++) {
+                Eigen::Map<const Eigen::MatrixXd> first = archive.matrix(stride*i);
+                Eigen::Map<const Eigen::MatrixXd> b = archive.matrix(stride*i + stride - 1);
+                bool fits = first.rows() == n && b.rows() == n && b.cols() == 1;
+                if (factored) {
+                    Eigen::Map<const Eigen::MatrixXd> V = archive.matrix(stride*i + 1);
+                    fits &= V.rows() == n && V.cols() == first.cols();
+                } else {
+                    fits &= first.cols() == n;
+                }
+                if (!fits) {
+                    throw std::runtime_error("Option models of the wrong size in " + filename);
+                }
+            }
+
+            for (option_id i = 0; i < registry.size(); i++) {
+                LinearOptionModel* model = &registry.model(i);
+                if (factored) {
+                    model->U = archive.matrix(stride*i);
+                    model->V = archive.matrix(stride*i + 1);
+                } else if (modelRank) {
+                    // Factorize straight from the mapped file
+                    model->factorize(archive.matrix(stride*i), modelRank);
+                } else {
+                    model->F = archive.matrix(stride*i);
+                }
+                model->b = archive.vector(stride*i + stride - 1);
+            }
+            return;
+        }
+
         std::ifstream ifs(filename, std::ios::binary);
         boost::archive::text_iarchive ia(ifs);
-        for (auto it = options.begin(); it != options.end(); it++) {
-            ia >> optionModels[(*it)];
+        for (option_id i = 0; i < registry.size(); i++) {
+            LinearOptionModel* model;
+            ia >> model;
+
+            const int n = registry.getThetas().rows();
+            bool fits = model->b.size() == n;
+            if (model->factored()) {
+                fits &= model->U.rows() == n && model->V.rows() == n && model->V.cols() == model->U.cols();
+            } else {
+                fits &= model->F.rows() == n && model->F.cols() == n;
+            }
+            if (!fits) {
+                delete model;
+                throw std::runtime_error("Option models of the wrong size in " + filename);
+            }
+
+            // Only one dense model is in memory at any time
+            if (modelRank && !model->factored()) {
+                model->factorize(modelRank);
+            }
+            registry.model(i).swap(*model);
+            delete model;
         }
     }
 
 private:
+    /**
+     * Interleave intra-option learning with one planning update
+     * @param r The last reward
+     * @param phi The features of the current state, dense, sparse or binary
+     * @param lastPhi The features of the previous state
+     * @return The next primitive action
+     */
+    template<class Features>
+    int step(float r, const Features& phi, const Features& lastPhi);
+
+    /**
+     * The temporaries of the planning updates. Every planning thread 
+     * has its own, and the updates made within next_action use the agent's.
+     */
+    struct planning_workspace {
+        // The state drawn from the visited states
+        features_workspace state;
+
+        // The unit vector e_j of a sweep, and row j of a model
+        sparse_features unit;
+        Eigen::VectorXd row;
+
+        model_workspace model;
+    };
+
+    /**
+     * One planning update of every option at a given state
+     * @param phi The features of the state, dense, sparse or binary
+     * @param workspace The temporaries of the calling thread
+     */
+    template<class Features>
+    void plan(const Features& phi, planning_workspace& workspace);
+
+    /**
+     * Remember the current state, then spend the planning budget of this 
+     * step or hand it over to the planning threads.
+     * @param states The visited states
+     * @param phi The features of the current state
+     */
+    template<class Features>
+    void schedulePlanning(PlanningBuffer<Features>& states, const Features& phi);
+
+    /**
+     * One planning update, from the visited states or the sweep queue
+     * @param rng The random generator of the calling thread
+     * @param workspace The temporaries of the calling thread
+     * @return False if there was nothing to plan from
+     */
+    bool planOnce(Random& rng, planning_workspace& workspace);
+
+    /**
+     * One planning update of every option at the unit vector e_j, 
+     * then queue the features that lead to j.
+     * @param j Index of the feature
+     * @param workspace The temporaries of the calling thread
+     */
+    void sweep(unsigned j, planning_workspace& workspace);
+
+    /**
+     * Start the planning threads, if any
+     * @param threads The number of planning threads
+     */
+    void startPlanning(unsigned threads);
+
+    /**
+     * Main loop of a planning thread
+     * @param seed Seed of the random generator of the thread
+     */
+    void planningLoop(unsigned seed);
+
+    /**
+     * Join the planning threads
+     */
+    void stopPlanning();
+
+    /**
+     * @return A lock on the weights and the model of an option, 
+     * which only holds a mutex when planning in the background
+     */
+    std::unique_lock<std::mutex> lockOption(option_id o)
+    {
+        return optionLocks ? std::unique_lock<std::mutex>(optionLocks[o]) : std::unique_lock<std::mutex>();
+    }
+
+    /**
+     * Holds the locks on every option, taken in order, until destroyed
+     */
+    class options_lock
+    {
+    public:
+        options_lock(std::mutex* locks, unsigned size) : locks(locks), size(size)
+        {
+            for (unsigned o = 0; o < size; o++) {
+                locks[o].lock();
+            }
+        }
+
+        options_lock(options_lock&& other) : locks(other.locks), size(other.size) 
+        { 
+            other.locks = 0; 
+        }
+
+        ~options_lock()
+        {
+            for (unsigned o = size; locks && o > 0; o--) {
+                locks[o - 1].unlock();
+            }
+        }
+
+    private:
+        std::mutex* locks;
+        unsigned size;
+    };
+
+    /**
+     * @return The locks on every option, which only hold
+     * mutexes when planning in the background
+     */
+    options_lock lockOptions()
+    {
+        return options_lock(optionLocks.get(), optionLocks ? registry.size() : 0);
+    }
+
     // Path to the saved options
     std::string optionsFile;
     std::string optionModelsFile;
 
+    // Rank of the factored transition models, 0 to keep them dense
+    unsigned modelRank;
+
     // Last action executed
     int lastAction;
 
     // Last state visited
     Eigen::VectorXd lastPhi;
 
-    // The option that we are currently executing up to termination
-    LinearOption* currentOption;
+    // Last state visited, when learning from sparse features
+    sparse_features lastSparsePhi;
 
-    // Maximum value for next state from s
-    struct NextStateValueComparator {
-        NextStateValueComparator(DynaLOEMAgent* self, const Eigen::VectorXd& phi) : self(self), phi(phi) {}
+    // Last state visited, when learning from binary features
+    binary_features lastBinaryPhi;
 
-        bool operator() (LinearOption*& a, LinearOption*& b) { 
-            return a->theta.transpose()*self->optionModels[a]->F*phi < b->theta.transpose()*self->optionModels[b]->F*phi;     
-        }
+    // The current state, swapped with the last one after every step
+    Eigen::VectorXd phi;
+    sparse_features sparsePhi;
+    binary_features binaryPhi;
 
-        DynaLOEMAgent* self;
-        const Eigen::VectorXd& phi;
-    };
+    // Number of planning updates per real step
+    unsigned planningBudget;
+
+    // States visited, from which to plan
+    PlanningBuffer<Eigen::VectorXd> visitedStates;
+    PlanningBuffer<sparse_features> visitedSparseStates;
+    PlanningBuffer<binary_features> visitedBinaryStates;
+
+    // One per option when the models are learnt by least-squares
+    std::vector<LSTDOptionModelLearner> modelLearners;
+
+    // Plan by prioritized sweeping rather than from the visited states
+    bool prioritized;
+    SweepQueue sweeps;
+
+    std::vector<std::thread> planners;
 
-    // Choose new option according to main behavior policy 
-    struct ValueComparator {
-        ValueComparator(const Eigen::VectorXd& phi) : phi(phi) {}
-        bool operator() (LinearOption*& a, LinearOption*& b) { 
-            return a->theta.transpose()*phi < b->theta.transpose()*phi;     
+    // One mutex per option, only when planning in the background
+    std::unique_ptr<std::mutex[]> optionLocks;
+
+    // Planning updates handed over to the planning threads and not started yet
+    unsigned pendingUpdates;
+    bool planning;
+    std::mutex planningMutex;
+    std::condition_variable planningAvailable;
+
+    // The option that we are currently executing up to termination
+    option_id currentOption;
+
+    /**
+     * The quantities needed by one step, indexed by option id,
+     * and its temporaries. Kept across steps to reuse the storage,
+     * so that a step allocates nothing once they have grown.
+     */
+    struct step_workspace {
+        void resize(unsigned numOptions) 
+        {
+            modelValues.resize(numOptions);
+            betas.resize(numOptions);
+            greedyActions.resize(numOptions);
         }
-        const Eigen::VectorXd& phi;
+
+        // theta^T phi
+        Eigen::VectorXd values;
+
+        // theta^T F phi
+        Eigen::VectorXd modelValues;
+
+        // Termination probabilities in phi
+        std::vector<double> betas;
+
+        // Greedy action of every option in phi
+        std::vector<int> greedyActions;
+
+        // lastPhi - gamma*(1 - beta)*phi
+        features_workspace eta;
+
+        model_workspace model;
     };
+
+    step_workspace workspace;
+
+    // The temporaries of the planning updates made within next_action
+    planning_workspace planningWorkspace;
 };
 
 }
@@ -0,0 +1,81 @@
+#ifndef __EXPERIENCE_QUEUE_H__
+#define __EXPERIENCE_QUEUE_H__
+
+#include <vector>
+#include <atomic>
+#include <utility>
+
+namespace rl {
+
+/**
+ * Bounded ring buffer passing items from one producer thread to one
+ * consumer thread without locks. Items are swapped in and out of the
+ * slots, so that the buffers they own are recycled instead of
+ * reallocated once the ring has gone around once.
+ */
+template<class T>
+class ExperienceQueue
+{
+public:
+    /**
+     * @param capacity The number of items the queue can hold
+     */
+    ExperienceQueue(unsigned capacity) : slots(capacity + 1), head(0), tail(0) {};
+
+    /**
+     * Called by the producer only
+     * @param item Swapped into the queue on success
+     * @return False if the queue is full
+     */
+    bool push(T& item)
+    {
+        const unsigned t = tail.load(std::memory_order_relaxed);
+        const unsigned next = (t + 1) % slots.size();
+        if (next == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        std::swap(slots[t], item);
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Called by the consumer only
+     * @param item Swapped with the oldest item on success
+     * @return False if the queue is empty
+     */
+    bool pop(T& item)
+    {
+        const unsigned h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        std::swap(item, slots[h]);
+        head.store((h + 1) % slots.size(), std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @return The number of items waiting, possibly outdated by the time it is read
+     */
+    unsigned size() const
+    {
+        const unsigned n = slots.size();
+        return (tail.load(std::memory_order_acquire) + n - head.load(std::memory_order_acquire)) % n;
+    }
+
+private:
+    std::vector<T> slots;
+
+    // Next slot to read, owned by the consumer
+    std::atomic<unsigned> head;
+
+    // Next slot to write, owned by the producer
+    std::atomic<unsigned> tail;
+};
+
+} // namespace rl
+
+#endif
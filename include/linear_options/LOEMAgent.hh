@@ -5,9 +5,11 @@
 #include <linear_options/StateAbstraction.hh>
 #include <linear_options/SMDPAgent.hh>
 #include <linear_options/Option.hh>
+#include <linear_options/BinaryArchive.hh>
 
 #include <fstream>
 #include <iomanip>
+#include <stdexcept>
 #include <boost/serialization/vector.hpp>
 
 namespace rl {
@@ -21,6 +23,8 @@ public:
         epsilon(epsilon),
         gamma(gamma),
         stateAbstraction(&stateAbstraction),
+        sparseAbstraction(dynamic_cast<rl::sparse_state_abstraction*>(&stateAbstraction)),
+        binaryAbstraction(dynamic_cast<rl::binary_state_abstraction*>(&stateAbstraction)),
         rng(rng)
     {};
     virtual ~LOEMAgent() {};
@@ -35,24 +39,93 @@ public:
         oa << options;
     }
 
+    /**
+     * Save the options in the binary format
+     * @param filename Name under which to save the options
+     * @throw std::runtime_error If the file cannot be written
+     */
+    virtual void saveBinaryOptions(const std::string& filename) 
+    {
+        std::vector<binary_array> arrays;
+        for (unsigned i = 0; i < options.size(); i++) {
+            arrays.push_back(binary_array(options[i]->getActionValueThetas()));
+            arrays.push_back(binary_array(options[i]->theta));
+        }
+        saveBinary(filename, BINARY_OPTIONS, arrays);
+    }
+
     /**
      * @Override
+     * Accepts both the text and the binary format.
      */
     void loadOptions(const std::string& filename)
     {
+        if (isBinaryArchive(filename)) {
+            MappedArchive archive(filename);
+            if (archive.kind() != BINARY_OPTIONS || archive.size() % 2 != 0) {
+                throw std::runtime_error("Not an options archive " + filename);
+            }
+
+            // The value function of every option is over the features of its policy
+            for (unsigned i = 0; i < archive.size(); i += 2) {
+                if (archive.matrix(i + 1).cols() != 1 || archive.matrix(i + 1).rows() != archive.matrix(i).rows()) {
+                    throw std::runtime_error("Mismatched policy and value function in options archive " + filename);
+                }
+            }
+
+            options.clear();
+            for (unsigned i = 0; i < archive.size(); i += 2) {
+                LinearOption* option = new LinearOption();
+                option->setActionValueThetas(archive.matrix(i));
+                option->theta = archive.vector(i + 1);
+                options.push_back(option);
+            }
+            return;
+        }
+
         std::ifstream ifs(filename, std::ios::binary);
         boost::archive::text_iarchive ia(ifs);
         ia >> options;
+
+        for (unsigned i = 0; i < options.size(); i++) {
+            if (options[i]->theta.size() != options[i]->getActionValueThetas().rows()) {
+                throw std::runtime_error("Mismatched policy and value function in options archive " + filename);
+            }
+        }
     }
 
 protected:
     /**
      * Project the input state into a higher dimensional space
      * using the pre-defined state abstraction function. 
+     * @param phi Set to the features, reusing its storage
+     */
+    inline void project(const std::vector<float>& s, Eigen::VectorXd& phi) 
+    {
+        convertVector(s, state);
+        stateAbstraction->project(state, phi);
+    }
+
+    /**
+     * Project the input state and only keep the active features.
+     * Requires a sparse state abstraction.
+     * @param phi Set to the active features, reusing its storage
      */
-    inline Eigen::VectorXd project(const std::vector<float>& s) 
+    inline void project(const std::vector<float>& s, sparse_features& phi) 
     {
-        return (*stateAbstraction)(convertVector(s));  
+        convertVector(s, state);
+        sparseAbstraction->project(state, phi);
+    }
+
+    /**
+     * Project the input state and only keep the indices of the active 
+     * features. Requires a binary state abstraction.
+     * @param phi Set to the active features, reusing its storage
+     */
+    inline void project(const std::vector<float>& s, binary_features& phi) 
+    {
+        convertVector(s, state);
+        binaryAbstraction->project(state, phi);
     }
 
     // Contains the linear options loaded from disk
@@ -63,8 +136,17 @@ protected:
     double epsilon;
     double gamma;
     rl::state_abstraction* stateAbstraction;
+
+    // Non-null when the state abstraction can emit sparse features
+    rl::sparse_state_abstraction* sparseAbstraction;
+
+    // Non-null when the state abstraction can emit binary features
+    rl::binary_state_abstraction* binaryAbstraction;
     Random rng;
 
+    // Last input state, kept to reuse its storage
+    Eigen::VectorXd state;
+
 private:
     friend class boost::serialization::access;
     template<class Archive>
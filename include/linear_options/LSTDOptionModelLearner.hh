@@ -0,0 +1,159 @@
+#ifndef __LSTD_OPTION_MODEL_LEARNER_H__
+#define __LSTD_OPTION_MODEL_LEARNER_H__
+
+#include <linear_options/Option.hh>
+#include <linear_options/SparseFeatures.hh>
+
+#include <vector>
+#include <stdexcept>
+#include <Eigen/Core>
+#include <Eigen/LU>
+
+namespace rl {
+
+/**
+ * Least-squares estimator of a dense linear option model, as an alternative
+ * to the gradient rule of LinearOptionModel::update.
+ *
+ * For every transition from phi to phiPrime with reward r, where the option
+ * terminates in phiPrime with probability beta, let
+ * eta = phi - gamma*(1 - beta)*phiPrime. The estimates are the fixed point
+ *   F*A = C, b^T*A = d^T
+ * with A = epsilon*I + sum eta*phi^T, C = epsilon*F0 + sum gamma*beta*phiPrime*phi^T
+ * and d = epsilon*b0 + sum r*phi, where F0 and b0 are the model at the start.
+ *
+ * The inverse of A is kept up to date with the Sherman-Morrison formula,
+ * so that every transition costs O(n^2) whatever the learning rate, and
+ * the estimates are exact after every step. When recording, solve()
+ * re-solves the system from the logged transitions instead. The 
+ * temporaries of update() are kept, so that only recording allocates.
+ */
+class LSTDOptionModelLearner
+{
+public:
+    /**
+     * @param model The dense model to estimate, which serves as the prior
+     * @param gamma The discount factor
+     * @param regularization The weight epsilon of the prior
+     * @param record Keep every transition for solve()
+     */
+    LSTDOptionModelLearner(const LinearOptionModel& model, double gamma, double regularization, bool record = false) :
+        gamma(gamma),
+        regularization(regularization),
+        record(record),
+        inverse(Eigen::MatrixXd::Identity(model.F.rows(), model.F.cols())/regularization)
+    {
+        if (record) {
+            priorF = model.F;
+            priorB = model.b;
+        }
+    }
+
+    /**
+     * Update the model with one transition
+     * @param model The model to update
+     * @param phi The features before the transition
+     * @param r The reward of the transition
+     * @param phiPrime The features after the transition
+     * @param beta The probability of terminating in phiPrime
+     */
+    template<class Features>
+    void update(LinearOptionModel& model, const Features& phi, double r, const Features& phiPrime, double beta)
+    {
+        auto& eta = etaStorage.combination(phi);
+        assign(eta, phi);
+        axpy(-gamma*(1 - beta), phiPrime, eta);
+
+        // Sherman-Morrison update of the inverse of A after A += eta*phi^T
+        product(inverse, eta, u);
+        transposeProduct(inverse, phi, gain);
+        gain /= 1 + dot(gain, eta);
+        inverse.noalias() -= u*gain.transpose();
+
+        // F <- F + (gamma*beta*phiPrime - F*eta)*gain^T
+        product(model.F, eta, error);
+        error = -error;
+        axpy(gamma*beta, phiPrime, error);
+        rankUpdate(1.0, error, gain, model.F);
+
+        // b <- b + (r - b^T*eta)*gain
+        model.b += (r - dot(model.b, eta))*gain;
+
+        if (record) {
+            transitions.push_back(transition(toSparse(phi), r, toSparse(phiPrime), beta));
+        }
+    }
+
+    /**
+     * Solve for the model from the prior and the recorded transitions,
+     * with one O(n^3) factorization. The incremental updates carry on
+     * from the solution.
+     * @param model The model to replace
+     * @throw std::logic_error If the transitions are not recorded
+     */
+    void solve(LinearOptionModel& model)
+    {
+        if (!record) {
+            throw std::logic_error("The least-squares models can only be solved from recorded transitions");
+        }
+
+        const int n = inverse.rows();
+        Eigen::MatrixXd A = regularization*Eigen::MatrixXd::Identity(n, n);
+        Eigen::MatrixXd C = regularization*priorF;
+        Eigen::VectorXd d = regularization*priorB;
+
+        for (auto it = transitions.begin(); it != transitions.end(); it++) {
+            sparse_features eta = it->phi;
+            axpy(-gamma*(1 - it->beta), it->phiPrime, eta);
+
+            rankUpdate(1.0, eta.toDense(), it->phi, A);
+            rankUpdate(gamma*it->beta, it->phiPrime.toDense(), it->phi, C);
+            axpy(it->reward, it->phi, d);
+        }
+
+        // F = C*A^-1 and b = A^-T*d
+        Eigen::PartialPivLU<Eigen::MatrixXd> lu(A.transpose());
+        model.F = lu.solve(C.transpose()).transpose();
+        model.b = lu.solve(d);
+        inverse = lu.inverse().transpose();
+    }
+
+    /**
+     * @return The number of recorded transitions
+     */
+    unsigned size() const { return transitions.size(); }
+
+private:
+    struct transition {
+        transition(const sparse_features& phi, double reward, const sparse_features& phiPrime, double beta) :
+            phi(phi), reward(reward), phiPrime(phiPrime), beta(beta) {};
+
+        sparse_features phi;
+        double reward;
+        sparse_features phiPrime;
+        double beta;
+    };
+
+    double gamma;
+    double regularization;
+    bool record;
+
+    // Inverse of A
+    Eigen::MatrixXd inverse;
+
+    // The model at the start, only when recording
+    Eigen::MatrixXd priorF;
+    Eigen::VectorXd priorB;
+
+    std::vector<transition> transitions;
+
+    // Temporaries of update()
+    features_workspace etaStorage;
+    Eigen::VectorXd u;
+    Eigen::VectorXd gain;
+    Eigen::VectorXd error;
+};
+
+} // namespace rl
+
+#endif
@@ -5,6 +5,8 @@
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
 
+#include <memory>
+
 namespace rl {
 
 /**
@@ -19,6 +21,24 @@ class LinearQ0Learner : public Agent
 {
 public:
     LinearQ0Learner(unsigned numActions, double alpha, double epsilon, double gamma, rl::state_abstraction& stateAbstraction, Random rng = Random());
+
+    /**
+     * Hogwild worker: a learner with its own episode state, state abstraction
+     * and random number stream which reads and updates the action values of 
+     * another learner in place, without any locking. Meant for many workers
+     * training the same option from their own environments. With sparse
+     * features two workers rarely update the same weights at once, and a
+     * lost update only delays learning; the weights are not resized
+     * while the workers run. Only the action values and the learning 
+     * parameters are shared. The worker projects through and resets the
+     * given abstraction, so stateful ones, like an incremental 
+     * room_abstraction, must not be shared with other threads.
+     * @param shared The learner owning the action values
+     * @param abstraction The state abstraction of this worker, with the same features as the one of shared
+     * @param rng The random number stream of this worker
+     * @throw std::invalid_argument If the abstraction does not have as many features as the action values
+     */
+    LinearQ0Learner(LinearQ0Learner& shared, rl::state_abstraction& abstraction, Random rng);
     virtual ~LinearQ0Learner() {};
 
     /**
@@ -48,12 +68,24 @@ public:
     void savePolicy(const std::string& filename);
 
     /**
-     * Load the parameter vectors from file
+     * Save the parameter vectors for every action in the binary format
      * @param filename The path to the file containing the theta parameters for every action
+     * @throw std::runtime_error If the file cannot be written
+     */
+    void saveBinaryPolicy(const std::string& filename);
+
+    /**
+     * Load the parameter vectors from file, in the text or binary format
+     * @param filename The path to the file containing the theta parameters for every action
+     * @throw std::runtime_error If the file does not hold a policy over these features and actions
      */
     void loadPolicy(const std::string& filename);
 
-protected:
+    /**
+     * @return The weights of the pseudo-Q-function, one column per action
+     */
+    const Eigen::MatrixXd& getActionValueThetas() const { return actionValueThetas; }
+
     /**
      * Return the best action to take with respect to the current theta estimates
      * for every action. 
@@ -62,6 +94,54 @@ protected:
      */
     int getBestAction(const Eigen::VectorXd& phi);
 
+    /**
+     * Return the best action to take with respect to the current theta estimates
+     * for every action. 
+     * @param phi The active features of the current state
+     * @return The action corresponding to the greedy policy
+     */
+    int getBestAction(const sparse_features& phi);
+
+    /**
+     * Return the best action to take with respect to the current theta estimates
+     * for every action. 
+     * @param phi The active binary features of the current state
+     * @return The action corresponding to the greedy policy
+     */
+    int getBestAction(const binary_features& phi);
+
+    /**
+     * Q-learning update from a transition generated by any behavior policy.
+     * @param phi The features of the state in which the action was taken
+     * @param action The action taken
+     * @param reward The reward received for the transition
+     * @param phiPrime The features of the next state
+     * @param terminal If true, the next state is not bootstrapped from
+     */
+    void learn(const Eigen::VectorXd& phi, int action, double reward, const Eigen::VectorXd& phiPrime, bool terminal);
+
+    /**
+     * Q-learning update from a transition generated by any behavior policy.
+     * @param phi The active features of the state in which the action was taken
+     * @param action The action taken
+     * @param reward The reward received for the transition
+     * @param phiPrime The active features of the next state
+     * @param terminal If true, the next state is not bootstrapped from
+     */
+    void learn(const sparse_features& phi, int action, double reward, const sparse_features& phiPrime, bool terminal);
+
+    /**
+     * Q-learning update from a transition generated by any behavior policy.
+     * @param phi The active binary features of the state in which the action was taken
+     * @param action The action taken
+     * @param reward The reward received for the transition
+     * @param phiPrime The active binary features of the next state
+     * @param terminal If true, the next state is not bootstrapped from
+     */
+    void learn(const binary_features& phi, int action, double reward, const binary_features& phiPrime, bool terminal);
+
+protected:
+
     /**
      * Choose the next action based on an epsilon-greedy strategy
      * @param phi The current state
@@ -70,53 +150,144 @@ protected:
     int epsilonGreedy(const Eigen::VectorXd& phi);
 
     /**
-     * Convert an STL vector to an Eigen::Vector of double.
+     * Choose the next action based on an epsilon-greedy strategy
+     * @param phi The active features of the current state
+     * @return A primitive action uniformly at random with epsilon, (1 - epsilon) the best action.
+     */
+    int epsilonGreedy(const sparse_features& phi);
+
+    /**
+     * Choose the next action based on an epsilon-greedy strategy
+     * @param phi The active binary features of the current state
+     * @return A primitive action uniformly at random with epsilon, (1 - epsilon) the best action.
+     */
+    int epsilonGreedy(const binary_features& phi);
+
+    /**
+     * Convert an STL vector to an Eigen::Vector of double in place.
      * @param s The vector to convert
-     * @return The Eigen::Vector representation.
+     * @param out Set to the Eigen::Vector representation, reusing its storage
      * FIXME Duplicate code. 
      */
-    Eigen::VectorXd convertVector(const std::vector<float>& s) {
-        Eigen::VectorXd out(s.size());
+    void convertVector(const std::vector<float>& s, Eigen::VectorXd& out) {
+        out.resize(s.size());
         for (unsigned i = 0; i < s.size(); i++) {
             out(i) = s[i];
         }
-        return out; 
     }
 
     /**
      * Project the input state into a higher dimensional space
      * using the pre-defined state abstraction function. 
+     * @param phi Set to the features, reusing its storage
+     */
+    inline void project(const std::vector<float>& s, Eigen::VectorXd& phi) 
+    {
+        convertVector(s, state);
+        stateAbstraction->project(state, phi);
+    }
+
+    /**
+     * Project the input state and only keep the active features.
+     * Requires a sparse state abstraction.
+     * @param phi Set to the active features, reusing its storage
+     */
+    inline void project(const std::vector<float>& s, sparse_features& phi) 
+    {
+        convertVector(s, state);
+        sparseAbstraction->project(state, phi);
+    }
+
+    /**
+     * Project the input state and only keep the indices of the active 
+     * features. Requires a binary state abstraction.
+     * @param phi Set to the active features, reusing its storage
      */
-    inline Eigen::VectorXd project(const std::vector<float>& s) 
+    inline void project(const std::vector<float>& s, binary_features& phi) 
     {
-        return (*stateAbstraction)(convertVector(s));  
+        convertVector(s, state);
+        binaryAbstraction->project(state, phi);
     }
 
-    // Serialization for model parameters 
+    // Serialization for model parameters. 
+    // The archives keep one vector per action.
     friend class boost::serialization::access;
     template<class Archive>
-    void serialize(Archive & ar, const unsigned int version)
+    void save(Archive & ar, const unsigned int version) const
+    {
+        const std::vector<Eigen::VectorXd> thetas = columns(actionValueThetas);
+        ar << thetas;
+    }
+
+    template<class Archive>
+    void load(Archive & ar, const unsigned int version)
     {
-        ar & actionValueThetas;
+        std::vector<Eigen::VectorXd> thetas;
+        ar >> thetas;
+        actionValueThetas = fromColumns(thetas);
     }
+    BOOST_SERIALIZATION_SPLIT_MEMBER()
 
-    // Linear approximation for the pseudo-Q-function. 
+    // Storage of the action values, shared by the Hogwild workers
+    std::shared_ptr<Eigen::MatrixXd> sharedThetas;
+
+    // Linear approximation for the pseudo-Q-function, one column per action. 
     // Used by the option's policy for control
-    std::vector<Eigen::VectorXd> actionValueThetas;
+    Eigen::MatrixXd& actionValueThetas;
 
     unsigned numActions;
     double alpha;
     double epsilon;
     double gamma;
     rl::state_abstraction* stateAbstraction;
+
+    // Non-null when the state abstraction can emit sparse features
+    rl::sparse_state_abstraction* sparseAbstraction;
+
+    // Non-null when the state abstraction can emit binary features
+    rl::binary_state_abstraction* binaryAbstraction;
     Random rng;
 
 private:
+    /**
+     * Move the value of an action towards the target
+     * @param action The action taken
+     * @param target The one-step TD target
+     * @param phi The features of the state in which the action was taken
+     */
+    template<class Features>
+    void tdUpdate(int action, double target, const Features& phi);
+
+    /**
+     * @param phiPrime The features of the next state
+     * @return The value of the greedy action in the next state
+     */
+    template<class Features>
+    double maxValue(const Features& phiPrime);
+
     // Last primitive action executed during learning
     int lastAction;
    
     // Last state visited 
     Eigen::VectorXd lastPhi; 
+
+    // Last state visited, when learning from sparse features
+    sparse_features lastSparsePhi;
+
+    // Last state visited, when learning from binary features
+    binary_features lastBinaryPhi;
+
+    // Storage reused by every step: the input state, the next 
+    // state in every representation and the action values
+    Eigen::VectorXd state;
+    Eigen::VectorXd phiPrime;
+    sparse_features sparsePhiPrime;
+    binary_features binaryPhiPrime;
+    Eigen::VectorXd actionValues;
+
+    // A copy would silently share the action values
+    LinearQ0Learner(const LinearQ0Learner&);
+    LinearQ0Learner& operator=(const LinearQ0Learner&);
 };
 } // namespace rl
 
@@ -2,17 +2,42 @@
 #define __OPTION_H__
 
 #include <linear_options/serialization.hh>
+#include <linear_options/SparseFeatures.hh>
+#include <linear_options/ActionValues.hh>
+#include <linear_options/StateAbstraction.hh>
 
+#include <cmath>
 #include <limits>
+#include <algorithm>
 #include <Eigen/Core>
+#include <Eigen/QR>
+#include <Eigen/SVD>
+#include <boost/serialization/split_member.hpp>
+#include <boost/serialization/vector.hpp>
+#include <boost/serialization/version.hpp>
 #include <rl_common/Random.h>
 
 namespace rl {
 
 /**
- * Tagging interface
+ * Agreement of a reduced precision copy of the weights of an option
+ * with the double precision weights, over a sweep of states
  */
-struct Option {}; 
+struct policy_calibration
+{
+    policy_calibration() : agreement(1) {};
+
+    // Fraction of the states in which the greedy actions are the same
+    double agreement;
+};
+
+/**
+ * Tagging interface. Options are deleted through it, hence the virtual destructor.
+ */
+struct Option 
+{
+    virtual ~Option() {}
+}; 
 
 /**
  * A linear option is an extension for the
@@ -24,7 +49,7 @@ struct Option {};
  */
 struct LinearOption : public Option
 {
-    LinearOption() : rng(Random()) {};
+    LinearOption() : precision(DOUBLE_POLICY), rng(Random()) {};
 
     /**
      * @param s The n-dimensional feature vector. 
@@ -46,67 +71,501 @@ struct LinearOption : public Option
      */
     bool terminate(const Eigen::VectorXd& s) { return rng.uniform() < beta(s); }
 
+    /**
+     * Subclasses with a state-dependent beta must override all three
+     * overloads; denseBeta() forwards to the dense one at O(n) per call.
+     * @param phi The active features of the n-dimensional feature vector.
+     * @return The probability of termination given a feature vector
+     */
+    virtual double beta(const sparse_features& phi) { return 1; }
+
+    /**
+     * Indicate if the option should terminate in the current state
+     * @param phi The active features of the n-dimensional feature vector.
+     * @return True if the execution of the option must stop, false otherwise.
+     */
+    bool terminate(const sparse_features& phi) { return rng.uniform() < beta(phi); }
+
+    /**
+     * @param phi The active binary features of the n-dimensional feature vector.
+     * @return The probability of termination given a feature vector
+     */
+    virtual double beta(const binary_features& phi) { return 1; }
+
+    /**
+     * Indicate if the option should terminate in the current state
+     * @param phi The active binary features of the n-dimensional feature vector.
+     * @return True if the execution of the option must stop, false otherwise.
+     */
+    bool terminate(const binary_features& phi) { return rng.uniform() < beta(phi); }
+
     /**
      * Returns the best action to choose in every state
      * @param phi The current state
      * @return The best action to choose from state phi
      */
-    int greedyPolicy(const Eigen::VectorXd& phi) { 
-        double maxValue;
-        double maxAction = -1*std::numeric_limits<double>::max();
-        for (unsigned i = 0; i < actionValueThetas.size(); i++) {
-           if (actionValueThetas[i].dot(phi) > maxValue) {
-               maxAction = i;
-           }
+    int greedyPolicy(const Eigen::VectorXd& phi) { return greedy(phi); }
+
+    /**
+     * Returns the best action to choose in every state
+     * @param phi The active features of the current state
+     * @return The best action to choose from state phi
+     */
+    int greedyPolicy(const sparse_features& phi) { return greedy(phi); }
+
+    /**
+     * Returns the best action to choose in every state
+     * @param phi The active binary features of the current state
+     * @return The best action to choose from state phi
+     */
+    int greedyPolicy(const binary_features& phi) { return greedy(phi); }
+
+    /**
+     * The option value is always read from theta, which may be rewritten
+     * at any time, e.g. by OptionRegistry::store()
+     * @param phi The current state, dense, sparse or binary
+     * @return The value theta^T phi of the option
+     */
+    template<class Features>
+    double value(const Features& phi) const { return dot(theta, phi); }
+
+    /**
+     * Evaluate the greedy policy from a reduced precision copy of the 
+     * weights, padded for SIMD: in single precision, or in 8 bits with one 
+     * scale per action. The policy of an option is fixed once learnt, so 
+     * the copy is only refreshed by setActionValueThetas.
+     * @param precision DOUBLE_POLICY to go back to the double precision weights
+     * @throw std::invalid_argument If the option has more than MAX_ACTIONS actions
+     */
+    void setPolicyPrecision(policy_precision precision)
+    {
+        padded_action_values padded;
+        quantized_action_values quantized;
+        if (precision == FLOAT_POLICY) {
+            padded.assign(actionValueThetas);
+        } else if (precision == INT8_POLICY) {
+            quantized.assign(actionValueThetas);
         }
 
-        return maxAction;
+        // Only switch once the copy is made, so that a failure leaves the option as it was
+        this->precision = precision;
+        paddedPolicy = padded;
+        quantizedPolicy = quantized;
+    }
+
+    /**
+     * Evaluate the greedy policy from a single precision copy of the weights
+     * @param enable If false, go back to the double precision weights
+     */
+    void usePaddedPolicy(bool enable = true) { setPolicyPrecision(enable ? FLOAT_POLICY : DOUBLE_POLICY); }
+
+    /**
+     * @return The precision of the weights evaluated by greedyPolicy
+     */
+    policy_precision getPolicyPrecision() const { return precision; }
+
+    /**
+     * @return The size in bytes of the weights evaluated by greedyPolicy and value
+     */
+    size_t inferenceBytes() const
+    {
+        size_t bytes = theta.size()*sizeof(double);
+        if (precision == FLOAT_POLICY) {
+            return bytes + paddedPolicy.bytes();
+        } else if (precision == INT8_POLICY) {
+            return bytes + quantizedPolicy.bytes();
+        }
+        return bytes + actionValueThetas.size()*sizeof(double);
+    }
+
+    /**
+     * Compare the greedy actions of a reduced precision copy of the weights
+     * with those of the double precision weights, over a sweep of states. 
+     * The precision in use is left unchanged.
+     * @param precision The precision to calibrate
+     * @param abstraction The projection of the states into the features
+     * @param states The states, one per column
+     * @return The agreement of the greedy actions
+     */
+    policy_calibration calibrate(policy_precision precision, sparse_state_abstraction& abstraction, const Eigen::MatrixXd& states)
+    {
+        if (precision == FLOAT_POLICY) {
+            return calibrate(padded_action_values(), abstraction, states);
+        } else if (precision == INT8_POLICY) {
+            return calibrate(quantized_action_values(), abstraction, states);
+        }
+        return policy_calibration();
+    }
+
+    /**
+     * @return The weights of the pseudo-Q-function, one column per action
+     */
+    const Eigen::MatrixXd& getActionValueThetas() const { return actionValueThetas; }
+
+    /**
+     * @param thetas The weights of the pseudo-Q-function, one column per action
+     */
+    void setActionValueThetas(const Eigen::MatrixXd& thetas) 
+    { 
+        actionValueThetas = thetas; 
+        if (precision != DOUBLE_POLICY) {
+            setPolicyPrecision(precision);
+        }
     }
 
     // The option's parameter vector that we are learning. 
     // Used by the behavior policy for control
     Eigen::VectorXd theta;
 
+protected:
+    /**
+     * Evaluates the dense beta on a densified copy of phi, for subclasses 
+     * that opt into it from their sparse or binary overloads.
+     * @param phi The active features of the n-dimensional feature vector.
+     * @return The probability of termination given a feature vector
+     */
+    template<class Features>
+    double denseBeta(const Features& phi)
+    {
+        phi.toDense(densePhi);
+        return beta(densePhi);
+    }
+
 private:
-    // Linear approximation for the pseudo-Q-function. 
+    // Linear approximation for the pseudo-Q-function, one column per action. 
     // Used by the option's policy for control
-    std::vector<Eigen::VectorXd> actionValueThetas;
+    Eigen::MatrixXd actionValueThetas;
+
+    // Optional reduced precision copy of actionValueThetas
+    policy_precision precision;
+    padded_action_values paddedPolicy;
+    quantized_action_values quantizedPolicy;
+
+    // Storage reused by greedyPolicy and denseBeta
+    Eigen::VectorXd actionValues;
+    Eigen::VectorXd densePhi;
+
+    template<class Features>
+    int greedy(const Features& phi)
+    {
+        if (precision == FLOAT_POLICY) {
+            return paddedPolicy.greedy(phi);
+        } else if (precision == INT8_POLICY) {
+            return quantizedPolicy.greedy(phi);
+        }
+
+        int maxAction = 0;
+        transposeProduct(actionValueThetas, phi, actionValues);
+        actionValues.maxCoeff(&maxAction);
+        return maxAction;
+    }
+
+    template<class Reduced>
+    policy_calibration calibrate(Reduced reduced, sparse_state_abstraction& abstraction, const Eigen::MatrixXd& states)
+    {
+        const int numActions = actionValueThetas.cols();
+        reduced.assign(actionValueThetas);
+
+        policy_calibration calibration;
+        sparse_features phi;
+        Eigen::VectorXd q;
+        padded_action_values::value_vector reducedQ;
+        int agreements = 0;
+        for (int j = 0; j < states.cols(); j++) {
+            abstraction.project(states.col(j), phi);
+            transposeProduct(actionValueThetas, phi, q);
+            reduced.evaluate(phi, reducedQ);
+
+            int action = 0;
+            q.maxCoeff(&action);
+            agreements += (padded_action_values::argmax(reducedQ, numActions) == action);
+        }
+        calibration.agreement = states.cols() ? double(agreements)/states.cols() : 1;
+        return calibration;
+    }
 
-    // Serialization for model parameters 
+    // Serialization for model parameters. 
+    // The archives keep one vector per action.
     friend class boost::serialization::access;
     template<class Archive>
-    void serialize(Archive & ar, const unsigned int version)
+    void save(Archive & ar, const unsigned int version) const
+    {
+        const std::vector<Eigen::VectorXd> thetas = columns(actionValueThetas);
+        ar << thetas;
+        ar << theta;
+    }
+
+    template<class Archive>
+    void load(Archive & ar, const unsigned int version)
     {
-        ar & actionValueThetas;
-        ar & theta;
+        std::vector<Eigen::VectorXd> thetas;
+        ar >> thetas;
+        ar >> theta;
+        setActionValueThetas(fromColumns(thetas));
     }
+    BOOST_SERIALIZATION_SPLIT_MEMBER()
 
     Random rng;
 };
 
+/**
+ * Temporaries of the model computations, kept by the caller
+ * so that their storage is reused from one step to the next
+ */
+struct model_workspace
+{
+    // n entries: F*phi, or the prediction error of an update
+    Eigen::VectorXd error;
+
+    // k entries each, for the factored model: V^T*eta and U^T*error
+    Eigen::VectorXd z;
+    Eigen::VectorXd g;
+};
+
 /**
  * A model can be associated with a linear option.
  * The learning algorithm is implemented in the derived classes.
+ *
+ * The transition model is either a dense n x n matrix F, or its
+ * factorization F = U*V^T of rank k which takes O(n*k) memory and 
+ * O(n*k) operations to apply or to update.
  */
 struct LinearOptionModel
 {
-    // Transition model
+    LinearOptionModel() {};
+
+    /**
+     * A factored model with small random factors. 
+     * U = V = 0 is a stationary point of the factored update, 
+     * hence the factors cannot start from zero.
+     * @param n The number of features
+     * @param rank The rank k of the transition model
+     * @param scale The magnitude of the initial factors
+     */
+    LinearOptionModel(int n, unsigned rank, double scale = 1e-3) : 
+        b(Eigen::VectorXd::Zero(n)),
+        U(scale*Eigen::MatrixXd::Random(n, rank)),
+        V(scale*Eigen::MatrixXd::Random(n, rank)) {};
+
+    /**
+     * @return True if the transition model is stored as U*V^T
+     */
+    bool factored() const { return U.cols() > 0; }
+
+    /**
+     * @return The rank of the factored transition model, 0 if dense
+     */
+    unsigned rank() const { return U.cols(); }
+
+    /**
+     * @param phi The features of the current state, dense or sparse
+     * @return The expected features at termination F*phi
+     */
+    template<class Features>
+    Eigen::VectorXd predict(const Features& phi) const
+    {
+        if (factored()) {
+            return U*transposeProduct(V, phi);
+        }
+        return product(F, phi);
+    }
+
+    /**
+     * @param theta The value function weights of the option
+     * @param phi The features of the current state, dense or sparse
+     * @return The expected value at termination theta^T*F*phi
+     */
+    template<class Derived, class Features>
+    double value(const Eigen::MatrixBase<Derived>& theta, const Features& phi) const
+    {
+        model_workspace workspace;
+        return value(theta, phi, workspace);
+    }
+
+    /**
+     * Same as value(theta, phi), without allocating once the workspace has grown
+     * @param workspace The temporaries
+     */
+    template<class Derived, class Features>
+    double value(const Eigen::MatrixBase<Derived>& theta, const Features& phi, model_workspace& workspace) const
+    {
+        if (factored()) {
+            // (U^T*theta)^T (V^T*phi), one column of U at a time
+            transposeProduct(V, phi, workspace.z);
+            double out = 0;
+            for (int i = 0; i < U.cols(); i++) {
+                out += U.col(i).dot(theta)*workspace.z(i);
+            }
+            return out;
+        }
+
+        product(F, phi, workspace.error);
+        return theta.dot(workspace.error);
+    }
+
+    /**
+     * @param j Index of a feature
+     * @return Row j of F: how much every feature leads to feature j at termination
+     */
+    Eigen::VectorXd row(int j) const
+    {
+        Eigen::VectorXd out;
+        row(j, out);
+        return out;
+    }
+
+    /**
+     * @param j Index of a feature
+     * @param out Set to row j of F, reusing its storage
+     */
+    void row(int j, Eigen::VectorXd& out) const
+    {
+        if (factored()) {
+            out.noalias() = V*U.row(j).transpose();
+            return;
+        }
+        out = F.row(j).transpose();
+    }
+
+    /**
+     * Intra-option update of the transition model 
+     * F <- F + alpha*(target - F*eta)*eta^T
+     * where the target is gammaBeta*phi. On the factors, this is one 
+     * gradient step on U and V for the same squared error.
+     * @param alpha The learning rate
+     * @param gammaBeta The discounted probability of terminating in phi
+     * @param phi The features of the current state
+     * @param eta The eligibility of the transition, lastPhi - gamma*(1 - beta)*phi,
+     * which is sparse rather than binary when phi is binary
+     */
+    template<class Features, class Eta>
+    void update(double alpha, double gammaBeta, const Features& phi, const Eta& eta)
+    {
+        model_workspace workspace;
+        update(alpha, gammaBeta, phi, eta, workspace);
+    }
+
+    /**
+     * Same as update(alpha, gammaBeta, phi, eta), without allocating 
+     * once the workspace has grown
+     * @param workspace The temporaries
+     */
+    template<class Features, class Eta>
+    void update(double alpha, double gammaBeta, const Features& phi, const Eta& eta, model_workspace& workspace)
+    {
+        Eigen::VectorXd& error = workspace.error;
+        if (!factored()) {
+            product(F, eta, error);
+            error = -error;
+            axpy(gammaBeta, phi, error);
+            rankUpdate(alpha, error, eta, F);
+            return;
+        }
+
+        transposeProduct(V, eta, workspace.z);
+        error.noalias() = -U*workspace.z;
+        axpy(gammaBeta, phi, error);
+
+        // Both gradients are taken at the current factors
+        workspace.g.noalias() = U.transpose()*error;
+        rankUpdate(alpha, error, workspace.z, U);
+        rankUpdate(alpha, eta, workspace.g, V);
+    }
+
+    /**
+     * Replace the transition model by a factorization of rank k of a 
+     * dense matrix. The factors come from a randomized truncated SVD 
+     * F ~ Q*B with Q an orthonormal basis of the range of F, and are 
+     * balanced as U = Q*Ub*sqrt(S), V = Vb*sqrt(S).
+     * @param dense The n x n transition model
+     * @param rank The rank k of the factorization
+     */
+    template<class Derived>
+    void factorize(const Eigen::MatrixBase<Derived>& dense, unsigned rank)
+    {
+        // Oversampling, and power iterations for slowly decaying spectra
+        const int samples = std::min<int>(rank + 10, dense.cols());
+        const int iterations = 2;
+
+        Eigen::MatrixXd Q = dense*Eigen::MatrixXd::Random(dense.cols(), samples);
+        for (int i = 0; i < iterations; i++) {
+            Q = Eigen::HouseholderQR<Eigen::MatrixXd>(Q).householderQ()*Eigen::MatrixXd::Identity(Q.rows(), samples);
+            Q = dense*(dense.transpose()*Q).eval();
+        }
+        Q = Eigen::HouseholderQR<Eigen::MatrixXd>(Q).householderQ()*Eigen::MatrixXd::Identity(Q.rows(), samples);
+
+        Eigen::MatrixXd B = Q.transpose()*dense;
+        Eigen::JacobiSVD<Eigen::MatrixXd> svd(B, Eigen::ComputeThinU | Eigen::ComputeThinV);
+
+        int k = std::min<int>(rank, samples);
+        Eigen::VectorXd root = svd.singularValues().head(k).cwiseSqrt();
+        U = Q*svd.matrixU().leftCols(k)*root.asDiagonal();
+        V = svd.matrixV().leftCols(k)*root.asDiagonal();
+    }
+
+    /**
+     * Factorize the dense transition model and release it
+     * @param rank The rank k of the factorization
+     */
+    void factorize(unsigned rank)
+    {
+        factorize(F, rank);
+        F = Eigen::MatrixXd();
+    }
+
+    /**
+     * Exchange the parameters of two models without copying them
+     */
+    void swap(LinearOptionModel& other)
+    {
+        F.swap(other.F);
+        b.swap(other.b);
+        U.swap(other.U);
+        V.swap(other.V);
+    }
+
+    // Transition model, when dense
     Eigen::MatrixXd F;
 
     // Reward model 
     Eigen::VectorXd b;
 
+    // Factors of the transition model F = U*V^T, when factored
+    Eigen::MatrixXd U;
+    Eigen::MatrixXd V;
+
 private:
-    // Serialization for model parameters 
+    // Serialization for model parameters.
+    // Version 0 archives only hold the dense model.
     friend class boost::serialization::access;
     template<class Archive>
     void serialize(Archive & ar, const unsigned int version)
     {
-        ar & F;
+        unsigned k = rank();
+        if (version > 0) {
+            ar & k;
+        }
+
+        // A loaded model only keeps the representation it was saved in
+        if (k > 0) {
+            ar & U;
+            ar & V;
+            if (Archive::is_loading::value) {
+                F.resize(0, 0);
+            }
+        } else {
+            ar & F;
+            if (Archive::is_loading::value) {
+                U.resize(0, 0);
+                V.resize(0, 0);
+            }
+        }
         ar & b;
     }
 };
 
 } // namespace rl
 
+BOOST_CLASS_VERSION(rl::LinearOptionModel, 1)
+
 #endif
@@ -0,0 +1,121 @@
+#ifndef __OPTION_REGISTRY_H__
+#define __OPTION_REGISTRY_H__
+
+#include <linear_options/Option.hh>
+#include <linear_options/SparseFeatures.hh>
+
+#include <vector>
+#include <Eigen/Core>
+
+namespace rl {
+
+// Position of an option in a registry, which never changes once added
+typedef unsigned option_id;
+
+/**
+ * Index-addressed storage for a set of options and their models.
+ * The value function weights of all the options are the columns of a
+ * single matrix, so that the values of every option in a state are
+ * one matrix-vector product. The models are kept by value in one array.
+ *
+ * The registry owns the weights: they are copied from the options
+ * when these are added, and written back by store().
+ */
+class OptionRegistry
+{
+public:
+    OptionRegistry() {};
+
+    /**
+     * @param option The option, which must outlive the registry.
+     * @return The id of the option, with an empty model
+     */
+    option_id add(LinearOption* option)
+    {
+        option_id id = options.size();
+        if (id == 0) {
+            thetas.resize(option->theta.size(), 0);
+        }
+        thetas.conservativeResize(Eigen::NoChange, id + 1);
+        thetas.col(id) = option->theta;
+
+        // Grow the models by swapping, to never copy a transition model
+        if (models.size() == models.capacity()) {
+            std::vector<LinearOptionModel> grown(models.size());
+            grown.reserve(2*models.size() + 1);
+            for (unsigned i = 0; i < models.size(); i++) {
+                grown[i].swap(models[i]);
+            }
+            models.swap(grown);
+        }
+        models.push_back(LinearOptionModel());
+
+        options.push_back(option);
+        return id;
+    }
+
+    /**
+     * @return The number of options
+     */
+    unsigned size() const { return options.size(); }
+
+    /**
+     * @return The option with the given id
+     */
+    LinearOption& option(option_id id) { return *options[id]; }
+
+    /**
+     * @return The model of the option with the given id
+     */
+    LinearOptionModel& model(option_id id) { return models[id]; }
+
+    /**
+     * @return The value function weights of the option with the given id
+     */
+    Eigen::MatrixXd::ColXpr theta(option_id id) { return thetas.col(id); }
+
+    /**
+     * @return The value function weights, one column per option
+     */
+    const Eigen::MatrixXd& getThetas() const { return thetas; }
+
+    /**
+     * @param phi The features of the current state, dense or sparse
+     * @return The value theta^T phi of every option
+     */
+    template<class Features>
+    Eigen::VectorXd values(const Features& phi) const
+    {
+        return transposeProduct(thetas, phi);
+    }
+
+    /**
+     * @param phi The features of the current state, dense or sparse
+     * @param out Set to the value theta^T phi of every option, reusing its storage
+     */
+    template<class Features>
+    void values(const Features& phi, Eigen::VectorXd& out) const
+    {
+        transposeProduct(thetas, phi, out);
+    }
+
+    /**
+     * Write the value function weights back into the options,
+     * before these are saved.
+     */
+    void store()
+    {
+        for (unsigned i = 0; i < options.size(); i++) {
+            options[i]->theta = thetas.col(i);
+        }
+    }
+
+private:
+    std::vector<LinearOption*> options;
+    std::vector<LinearOptionModel> models;
+    Eigen::MatrixXd thetas;
+};
+
+} // namespace rl
+
+#endif
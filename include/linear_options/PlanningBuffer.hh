@@ -0,0 +1,93 @@
+#ifndef __PLANNING_BUFFER_H__
+#define __PLANNING_BUFFER_H__
+
+#include <rl_common/Random.h>
+
+#include <vector>
+#include <mutex>
+
+namespace rl {
+
+/**
+ * Bounded memory of the feature vectors visited by an agent, from which
+ * the states of the planning updates are drawn. Once full, the oldest
+ * state is overwritten. Safe to share between the control thread that
+ * pushes and the planning threads that sample.
+ */
+template<class Features>
+class PlanningBuffer
+{
+public:
+    /**
+     * @param capacity The number of states to remember
+     */
+    PlanningBuffer(unsigned capacity = 0) : capacity(capacity), next(0) {};
+
+    /**
+     * Forget every state and change the capacity
+     * @param capacity The number of states to remember
+     */
+    void reset(unsigned capacity)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->capacity = capacity;
+        states.clear();
+        next = 0;
+    }
+
+    /**
+     * @param phi A visited state
+     */
+    void push(const Features& phi)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (capacity == 0) {
+            return;
+        }
+
+        if (states.size() < capacity) {
+            states.push_back(phi);
+        } else {
+            states[next] = phi;
+        }
+        next = (next + 1) % capacity;
+    }
+
+    /**
+     * @param rng The random generator of the calling thread
+     * @param phi Set to a visited state drawn uniformly
+     * @return False if no state was visited yet
+     */
+    bool sample(Random& rng, Features& phi)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (states.empty()) {
+            return false;
+        }
+
+        phi = states[rng.uniformDiscrete(0, states.size() - 1)];
+        return true;
+    }
+
+    /**
+     * @return The number of states in memory
+     */
+    unsigned size()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return states.size();
+    }
+
+private:
+    std::vector<Features> states;
+    unsigned capacity;
+
+    // Position of the next state to overwrite
+    unsigned next;
+
+    std::mutex mutex;
+};
+
+} // namespace rl
+
+#endif
@@ -0,0 +1,702 @@
+#ifndef __ROOM_ABSTRACTION_H__
+#define __ROOM_ABSTRACTION_H__
+
+#include <linear_options/StateAbstraction.hh>
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <Eigen/Core>
+
+namespace rl {
+
+/**
+ * We build the feature vector from a set of radial basis functions
+ * spread over the space in the x, y and psi dimensions.
+ * Activations below a threshold are clamped to zero, so only the few
+ * basis functions around the current pose are active.
+ *
+ * The batch projection evaluates every center of a state in single
+ * precision, with the coordinates of the centers in contiguous arrays so
+ * that the differences and the exponentials vectorize. Its activations
+ * match project() to a relative 2e-6, and may differ right at the cutoff.
+ *
+ * In incremental mode, project() only evaluates the centers near the
+ * last poses, which are looked up in a uniform grid over the centers.
+ * Since the robot moves by a small amount at every step, the lookup
+ * is only repeated once in a while, and a projection costs a small
+ * multiple of the number of active features instead of one
+ * evaluation per center.
+ */
+struct room_abstraction : public sparse_state_abstraction
+{
+    /**
+     * @param U The mean of the RBF
+     * @param C The diagonal of the precision matrix
+     * @param b The height of the RBF
+     */
+    room_abstraction(const Eigen::MatrixXd& U, const Eigen::Vector3d& C, double b) :
+       b(b), U(U), C(C.asDiagonal()), 
+       centerX(U.col(0).cast<float>()), centerY(U.col(1).cast<float>()), centerPsi(U.col(2).cast<float>()),
+       centerXLow(residual(U.col(0))), centerYLow(residual(U.col(1))), centerPsiLow(residual(U.col(2))),
+       incremental(false), candidatesValid(false) {};
+
+    /**
+     * Switch to the incremental projection. The candidate centers are those
+     * within the support of the RBF around the pose of the last lookup, 
+     * widened by a margin. They are looked up again after reset(), or once 
+     * the pose has moved by more than the margin along some dimension, so
+     * the features are always the same as in the full projection.
+     * Not thread-safe: every thread needs its own abstraction.
+     * @param margin The motion along x, y and psi allowed between two lookups
+     */
+    void setIncremental(const Eigen::Vector3d& margin)
+    {
+        incremental = true;
+        this->margin = margin;
+        buildIndex();
+        reset();
+    }
+
+    /**
+     * @Override
+     * The next incremental projection looks up its candidates
+     */
+    void reset() { candidatesValid = false; }
+
+    /**
+     * @param s Project the input vector in the n-d space
+     * @param phi The active features
+     */
+    void project(const Eigen::VectorXd& s, sparse_features& phi) {
+        phi.clear();
+        phi.dimension = length();
+
+        // The first 4 elements are binary indicator variables for floor color
+        for (int i = 0; i < 4; i++) {
+            if (s[i]) {
+                phi.push_back(i, s[i]);
+            }
+        }
+
+        // The next 3 elements: x, y, psi
+        if (!incremental) {
+            for (int i = 0; i < U.rows(); i++) {
+                evaluate(s, i, phi);
+            }
+            return;
+        }
+
+        Eigen::Vector3d pose = s.tail<3>();
+        if (!candidatesValid || ((pose - lookupPose).cwiseAbs().array() > margin.array()).any()) {
+            lookup(pose);
+        }
+        for (unsigned k = 0; k < candidates.size(); k++) {
+            evaluate(s, candidates[k], phi);
+        }
+    }
+
+    /**
+     * @Override
+     */
+    void projectBatch(const Eigen::MatrixXd& states, Eigen::MatrixXd& phi)
+    {
+        phi.resize(length(), states.cols());
+
+        const float cx = -0.5*C.diagonal()(0);
+        const float cy = -0.5*C.diagonal()(1);
+        const float cpsi = -0.5*C.diagonal()(2);
+        const float cutoff = CUTOFF;
+
+        // Exponents below minExponent give activations below the cutoff.
+        // Clamping them keeps the exponentials away from denormals.
+        const float minExponent = std::min(std::log(CUTOFF/b), 0.0) - 1;
+
+        Eigen::ArrayXf v(U.rows());
+        for (int i = 0; i < states.cols(); i++) {
+            // Floor color indicators
+            phi.col(i).head(4) = states.col(i).head(4);
+
+            // Every coordinate is split into a float and the float of its
+            // residual, so that the differences near the state are as precise
+            // as in double precision and only the exponentials lose accuracy
+            const float x = states(4, i), xLow = states(4, i) - x;
+            const float y = states(5, i), yLow = states(5, i) - y;
+            const float psi = states(6, i), psiLow = states(6, i) - psi;
+            v = (cx*((centerX - x) + (centerXLow - xLow)).square() + 
+                 cy*((centerY - y) + (centerYLow - yLow)).square() + 
+                 cpsi*((centerPsi - psi) + (centerPsiLow - psiLow)).square()).max(minExponent).exp()*float(b);
+            phi.col(i).tail(U.rows()) = (v >= cutoff).select(v, 0.0f).cast<double>();
+        }
+    }
+
+    int length() { return U.rows() + 4; }
+
+    // Activations below this value are set to zero
+    static constexpr double CUTOFF = 0.1;
+
+    // Largest number of cells of the spatial index along a dimension
+    static const int MAX_CELLS = 256;
+
+private:
+    /**
+     * @return What rounding the coordinates to floats leaves out, as floats
+     */
+    static Eigen::ArrayXf residual(const Eigen::VectorXd& coordinates)
+    {
+        return (coordinates - coordinates.cast<float>().cast<double>()).cast<float>();
+    }
+
+    /**
+     * Add the activation of center i if above the cutoff
+     */
+    void evaluate(const Eigen::VectorXd& s, int i, sparse_features& phi) const
+    {
+        double v = b*exp(-0.5*(s.tail(U.cols()) - U.row(i).transpose()).dot(C*(s.tail(U.cols()) - U.row(i).transpose())));
+        if (v >= CUTOFF) {
+            phi.push_back(i + 4, v);
+        }
+    }
+
+    /**
+     * Bucket the centers in a uniform grid whose cells are about 
+     * the size of the support of the RBF, widened by the margin
+     */
+    void buildIndex()
+    {
+        // An activation is above the cutoff only if every term of the 
+        // exponent is, hence within this radius of the center along each dimension
+        const double exponent = b > CUTOFF ? 2*std::log(b/CUTOFF) : 0;
+        const Eigen::Vector3d lower = U.colwise().minCoeff().transpose();
+        const Eigen::Vector3d upper = U.colwise().maxCoeff().transpose();
+        for (int k = 0; k < 3; k++) {
+            double precision = C.diagonal()(k);
+            radius(k) = precision > 0 ? std::sqrt(exponent/precision) : std::numeric_limits<double>::infinity();
+
+            double width = radius(k) + margin(k);
+            cells[k] = 1;
+            if (width > 0 && width < std::numeric_limits<double>::infinity()) {
+                cells[k] = std::min<double>(MAX_CELLS, std::max(1.0, std::ceil((upper(k) - lower(k))/width)));
+            }
+            origin(k) = lower(k);
+            cellSize(k) = (upper(k) - lower(k))/cells[k];
+        }
+
+        // Centers sorted by cell, with the first one of every cell
+        std::vector<int> cellOfCenter(U.rows());
+        cellStart.assign(cells[0]*cells[1]*cells[2] + 1, 0);
+        for (int i = 0; i < U.rows(); i++) {
+            cellOfCenter[i] = (cell(0, U(i, 0))*cells[1] + cell(1, U(i, 1)))*cells[2] + cell(2, U(i, 2));
+            cellStart[cellOfCenter[i] + 1] += 1;
+        }
+        for (unsigned c = 1; c < cellStart.size(); c++) {
+            cellStart[c] += cellStart[c - 1];
+        }
+
+        std::vector<int> next(cellStart.begin(), cellStart.end() - 1);
+        cellCenters.resize(U.rows());
+        for (int i = 0; i < U.rows(); i++) {
+            cellCenters[next[cellOfCenter[i]]++] = i;
+        }
+    }
+
+    /**
+     * @return The cell along dimension k of a coordinate, clamped to the grid
+     */
+    int cell(int k, double x) const
+    {
+        if (cells[k] == 1 || !(cellSize(k) > 0)) {
+            return 0;
+        }
+        double c = std::floor((x - origin(k))/cellSize(k));
+        return (int) std::min<double>(cells[k] - 1, std::max(0.0, c));
+    }
+
+    /**
+     * Gather the candidate centers around a pose, in increasing order
+     * so that the features come in the same order as in the full projection
+     * @param pose The x, y and psi coordinates
+     */
+    void lookup(const Eigen::Vector3d& pose)
+    {
+        const Eigen::Vector3d reach = radius + margin;
+
+        int lo[3], hi[3];
+        for (int k = 0; k < 3; k++) {
+            lo[k] = cell(k, pose(k) - reach(k));
+            hi[k] = cell(k, pose(k) + reach(k));
+        }
+
+        candidates.clear();
+        for (int cx = lo[0]; cx <= hi[0]; cx++) {
+            for (int cy = lo[1]; cy <= hi[1]; cy++) {
+                for (int cpsi = lo[2]; cpsi <= hi[2]; cpsi++) {
+                    int c = (cx*cells[1] + cy)*cells[2] + cpsi;
+                    for (int j = cellStart[c]; j < cellStart[c + 1]; j++) {
+                        int i = cellCenters[j];
+                        if (((U.row(i).transpose() - pose).cwiseAbs().array() <= reach.array()).all()) {
+                            candidates.push_back(i);
+                        }
+                    }
+                }
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+
+        lookupPose = pose;
+        candidatesValid = true;
+    }
+
+    double b;
+    Eigen::MatrixXd U;
+    Eigen::DiagonalMatrix<double, 3, 3> C;
+
+    // Single precision coordinates of the centers and their residuals, for the batch projection
+    Eigen::ArrayXf centerX;
+    Eigen::ArrayXf centerY;
+    Eigen::ArrayXf centerPsi;
+    Eigen::ArrayXf centerXLow;
+    Eigen::ArrayXf centerYLow;
+    Eigen::ArrayXf centerPsiLow;
+
+    // Incremental projection
+    bool incremental;
+    Eigen::Vector3d margin;
+
+    // Extent of the support of the RBF along every dimension
+    Eigen::Vector3d radius;
+
+    // Spatial index: the centers of cell c are cellCenters[cellStart[c]..cellStart[c+1])
+    int cells[3];
+    Eigen::Vector3d origin;
+    Eigen::Vector3d cellSize;
+    std::vector<int> cellStart;
+    std::vector<int> cellCenters;
+
+    // The centers near the pose of the last lookup
+    bool candidatesValid;
+    Eigen::Vector3d lookupPose;
+    std::vector<int> candidates;
+};
+
+/**
+ * A regularly spaced set of positions along one dimension
+ */
+struct grid_axis
+{
+    /**
+     * @param origin Position of the first point
+     * @param step Distance between two consecutive points
+     * @param count Number of points
+     */
+    grid_axis(double origin, double step, int count) :
+        origin(origin), step(step), count(count) {};
+
+    double at(int i) const { return origin + i*step; }
+
+    double origin;
+    double step;
+    int count;
+};
+
+/**
+ * Same features as room_abstraction when the centers lie on a regular
+ * x * y * psi grid. Since the precision matrix is diagonal, every
+ * Gaussian is the product of three one-dimensional factors. These are
+ * computed once per axis, and the products are only formed within the
+ * support window where an activation can exceed the cutoff.
+ *
+ * The batch projection computes the factors over contiguous arrays of
+ * the positions along each axis, so that the exponentials vectorize, and
+ * forms their products in single precision into a zeroed column.
+ */
+struct grid_rbf_abstraction : public sparse_state_abstraction
+{
+    /**
+     * @param x Position of the centers along x
+     * @param y Position of the centers along y
+     * @param psi Position of the centers along psi
+     * @param C The diagonal of the precision matrix
+     * @param b The height of the RBF
+     * @param windowed If false, every center is evaluated
+     */
+    grid_rbf_abstraction(const grid_axis& x, const grid_axis& y, const grid_axis& psi, const Eigen::Vector3d& C, double b, bool windowed = true) :
+        b(b), C(C), windowed(windowed)
+    {
+        axes.push_back(x);
+        axes.push_back(y);
+        axes.push_back(psi);
+
+        for (int k = 0; k < 3; k++) {
+            if (axes[k].count > MAX_AXIS_COUNT) {
+                throw std::invalid_argument("Too many centers along an axis of the grid");
+            }
+        }
+
+        for (int k = 0; k < 3; k++) {
+            positions[k].resize(axes[k].count);
+            for (int i = 0; i < axes[k].count; i++) {
+                positions[k](i) = axes[k].at(i);
+            }
+        }
+    };
+
+    /**
+     * @param s Project the input vector in the n-d space
+     * @param phi The active features
+     */
+    void project(const Eigen::VectorXd& s, sparse_features& phi) {
+        phi.clear();
+        phi.dimension = length();
+
+        // The first 4 elements are binary indicator variables for floor color
+        for (int i = 0; i < 4; i++) {
+            if (s[i]) {
+                phi.push_back(i, s[i]);
+            }
+        }
+
+        // One-dimensional factors within the support window of each axis
+        int lo[3], hi[3];
+        factor_array factors[3];
+        for (int k = 0; k < 3; k++) {
+            window(k, s[4 + k], lo[k], hi[k]);
+            factors[k].resize(hi[k] - lo[k]);
+            for (int i = lo[k]; i < hi[k]; i++) {
+                double d = s[4 + k] - axes[k].at(i);
+                factors[k](i - lo[k]) = exp(-0.5*C(k)*d*d);
+            }
+        }
+
+        // Index of the center (ix, iy, ipsi) is 4 + (ix*ny + iy)*npsi + ipsi
+        for (int ix = lo[0]; ix < hi[0]; ix++) {
+            double vx = b*factors[0](ix - lo[0]);
+            if (vx < room_abstraction::CUTOFF) {
+                continue;
+            }
+
+            for (int iy = lo[1]; iy < hi[1]; iy++) {
+                double vxy = vx*factors[1](iy - lo[1]);
+                if (vxy < room_abstraction::CUTOFF) {
+                    continue;
+                }
+
+                int offset = 4 + (ix*axes[1].count + iy)*axes[2].count;
+                for (int ipsi = lo[2]; ipsi < hi[2]; ipsi++) {
+                    double v = vxy*factors[2](ipsi - lo[2]);
+                    if (v >= room_abstraction::CUTOFF) {
+                        phi.push_back(offset + ipsi, v);
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * @Override
+     */
+    void projectBatch(const Eigen::MatrixXd& states, Eigen::MatrixXd& phi)
+    {
+        phi.setZero(length(), states.cols());
+
+        const float fb = b;
+        const float cutoff = room_abstraction::CUTOFF;
+
+        // Clamp the exponents of the factors away from denormals, as in room_abstraction
+        const double minExponent = std::min(std::log(room_abstraction::CUTOFF/b), 0.0) - 1;
+
+        // The factors are sized for the widest window once, so that the states do not allocate
+        int lo[3], hi[3];
+        Eigen::ArrayXf factors[3];
+        for (int k = 0; k < 3; k++) {
+            factors[k].resize(positions[k].size());
+        }
+
+        for (int i = 0; i < states.cols(); i++) {
+            // Floor color indicators
+            phi.col(i).head(4) = states.col(i).head(4);
+
+            for (int k = 0; k < 3; k++) {
+                const double s = states(4 + k, i);
+                window(k, s, lo[k], hi[k]);
+                factors[k].head(hi[k] - lo[k]) = (-0.5*C(k)*(positions[k].segment(lo[k], hi[k] - lo[k]) - s).square()).max(minExponent).exp().cast<float>();
+            }
+
+            double* column = phi.col(i).data();
+            for (int ix = lo[0]; ix < hi[0]; ix++) {
+                float vx = fb*factors[0](ix - lo[0]);
+                if (vx < cutoff) {
+                    continue;
+                }
+
+                for (int iy = lo[1]; iy < hi[1]; iy++) {
+                    float vxy = vx*factors[1](iy - lo[1]);
+                    if (vxy < cutoff) {
+                        continue;
+                    }
+
+                    int offset = 4 + (ix*axes[1].count + iy)*axes[2].count;
+                    for (int ipsi = lo[2]; ipsi < hi[2]; ipsi++) {
+                        float v = vxy*factors[2](ipsi - lo[2]);
+                        if (v >= cutoff) {
+                            column[offset + ipsi] = v;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    int length() { return axes[0].count*axes[1].count*axes[2].count + 4; }
+
+    // Largest number of centers along an axis, so that the factors live on the stack
+    static const int MAX_AXIS_COUNT = 256;
+
+    /**
+     * @return The centers of the RBF, in the same order as room_abstraction expects them
+     */
+    Eigen::MatrixXd centers() const
+    {
+        Eigen::MatrixXd U(axes[0].count*axes[1].count*axes[2].count, 3);
+        int i = 0;
+        for (int ix = 0; ix < axes[0].count; ix++) {
+            for (int iy = 0; iy < axes[1].count; iy++) {
+                for (int ipsi = 0; ipsi < axes[2].count; ipsi++) {
+                    U.row(i++) << axes[0].at(ix), axes[1].at(iy), axes[2].at(ipsi);
+                }
+            }
+        }
+        return U;
+    }
+
+private:
+    typedef Eigen::Array<double, Eigen::Dynamic, 1, 0, MAX_AXIS_COUNT, 1> factor_array;
+
+    /**
+     * Find the range of centers along an axis for which the
+     * activation can exceed the cutoff.
+     * @param k The axis
+     * @param s The coordinate of the state along the axis
+     * @param lo First index in the window
+     * @param hi One past the last index in the window
+     */
+    void window(int k, double s, int& lo, int& hi) const
+    {
+        lo = 0;
+        hi = axes[k].count;
+        if (!windowed || C(k) <= 0 || b <= room_abstraction::CUTOFF) {
+            return;
+        }
+
+        double radius = std::sqrt(2.0*std::log(b/room_abstraction::CUTOFF)/C(k));
+        lo = std::max(lo, (int) std::ceil((s - radius - axes[k].origin)/axes[k].step));
+        hi = std::min(hi, (int) std::floor((s + radius - axes[k].origin)/axes[k].step) + 1);
+        hi = std::max(lo, hi);
+    }
+
+    double b;
+    Eigen::Vector3d C;
+    bool windowed;
+    std::vector<grid_axis> axes;
+
+    // Positions along each axis in contiguous arrays, for the batch projection
+    Eigen::ArrayXd positions[3];
+};
+
+/**
+ * Tile coding of the rooms states. Several tilings partition the
+ * (x, y, psi) space into boxes, each tiling shifted by its own offset,
+ * and every tiling holds one set of tiles per floor color, plus one for
+ * when no color was sensed yet. A state activates exactly one tile per
+ * tiling, on top of the color indicators in the first 4 features, so the
+ * features are binary and their number is fixed.
+ *
+ * The coordinates are converted once to fixed point, in 1/RESOLUTION of
+ * a tile, after which the tiles are found with integer additions and
+ * shifts only. The heading wraps around, so that psi and psi + 2 pi fall
+ * in the same tile, and the positions are clamped to the tiled region.
+ * The tiles of every tiling cover the region with one extra tile along x
+ * and y, so that the offsets never push a state out of its tiling.
+ *
+ * There are many more features than centers of the RBF, so the option 
+ * models learnt over the tiles should be factored.
+ */
+struct tile_coding_abstraction : public binary_state_abstraction
+{
+    /**
+     * The tilings are offset by the asymmetric displacements (1, 3, 5)
+     * in units of 1/tilings of a tile
+     * @param lower The lowest x and y of the tiled region
+     * @param upper The highest x and y of the tiled region
+     * @param widths The size of a tile along x, y and psi. The heading 
+     * width is rounded so that a whole number of tiles make a turn.
+     * @param tilings The number of tilings
+     */
+    tile_coding_abstraction(const Eigen::Vector2d& lower, const Eigen::Vector2d& upper, const Eigen::Vector3d& widths, int tilings)
+    {
+        Eigen::MatrixXd offsets(tilings, 3);
+        for (int t = 0; t < tilings; t++) {
+            for (int k = 0; k < 3; k++) {
+                offsets(t, k) = double(((2*k + 1)*t) % tilings)/tilings;
+            }
+        }
+        init(lower, upper, widths, offsets);
+    }
+
+    /**
+     * @param lower The lowest x and y of the tiled region
+     * @param upper The highest x and y of the tiled region
+     * @param widths The size of a tile along x, y and psi
+     * @param offsets The shift of every tiling along x, y and psi, 
+     * one tiling per row, in fractions of a tile within [0, 1)
+     */
+    tile_coding_abstraction(const Eigen::Vector2d& lower, const Eigen::Vector2d& upper, const Eigen::Vector3d& widths, const Eigen::MatrixXd& offsets)
+    {
+        init(lower, upper, widths, offsets);
+    }
+
+    /**
+     * @param s Project the input vector in the n-d space
+     * @param phi The indices of the active features
+     */
+    void project(const Eigen::VectorXd& s, binary_features& phi)
+    {
+        encode(s, phi);
+    }
+
+    /**
+     * @param s Project the input vector in the n-d space
+     * @param phi The active features, all equal to one
+     */
+    void project(const Eigen::VectorXd& s, sparse_features& phi)
+    {
+        encode(s, phi);
+    }
+
+    int length() { return 4 + tilings*TILE_COLORS*counts[0]*counts[1]*counts[2]; }
+
+    /**
+     * @return The number of tilings, hence of active tiles in every state
+     */
+    int getTilings() const { return tilings; }
+
+    // Fixed point resolution of the coordinates, in bits per tile
+    static const int RESOLUTION_BITS = 12;
+    static const int RESOLUTION = 1 << RESOLUTION_BITS;
+
+    // The floor colors, and no color sensed yet
+    static const int TILE_COLORS = 5;
+
+private:
+    void init(const Eigen::Vector2d& lower, const Eigen::Vector2d& upper, const Eigen::Vector3d& widths, const Eigen::MatrixXd& offsets)
+    {
+        if (offsets.cols() != 3 || offsets.rows() < 1) {
+            throw std::invalid_argument("The offsets of the tilings must have one row of 3 per tiling");
+        }
+        tilings = offsets.rows();
+
+        for (int k = 0; k < 2; k++) {
+            origin[k] = lower(k);
+            scale[k] = RESOLUTION/widths(k);
+            counts[k] = (int) std::ceil((upper(k) - lower(k))/widths(k)) + 1;
+            limit[k] = (counts[k] - 1)*RESOLUTION - 1;
+        }
+
+        origin[2] = 0;
+        counts[2] = std::max(1, (int) std::floor(2*M_PI/widths(2) + 0.5));
+        scale[2] = counts[2]*RESOLUTION/(2*M_PI);
+        limit[2] = counts[2]*RESOLUTION;
+
+        shifts.resize(3*tilings);
+        for (int t = 0; t < tilings; t++) {
+            for (int k = 0; k < 3; k++) {
+                double fraction = offsets(t, k) - std::floor(offsets(t, k));
+                shifts[3*t + k] = std::min(RESOLUTION - 1, (int) (fraction*RESOLUTION));
+            }
+        }
+    }
+
+    static void activate(binary_features& phi, int i) { phi.push_back(i); }
+    static void activate(sparse_features& phi, int i) { phi.push_back(i, 1); }
+
+    template<class Features>
+    void encode(const Eigen::VectorXd& s, Features& phi) const
+    {
+        phi.clear();
+        phi.dimension = 4 + tilings*TILE_COLORS*counts[0]*counts[1]*counts[2];
+
+        // The first 4 elements are binary indicator variables for floor color
+        int color = TILE_COLORS - 1;
+        for (int i = 0; i < 4; i++) {
+            if (s[i]) {
+                activate(phi, i);
+                color = i;
+            }
+        }
+
+        // The only conversions to integers: positions clamped to the 
+        // tiled region, and the heading within one turn
+        int q[3];
+        for (int k = 0; k < 2; k++) {
+            q[k] = (int) std::min<double>(limit[k], std::max(0.0, std::floor((s[4 + k] - origin[k])*scale[k])));
+        }
+        double turns = std::floor(s[6]*scale[2]/limit[2]);
+        q[2] = std::min(limit[2] - 1, std::max(0, (int) std::floor(s[6]*scale[2] - turns*limit[2])));
+
+        // Index of the tile (t, color, ix, iy, ipsi) is 4 + (((t*TILE_COLORS + color)*nx + ix)*ny + iy)*npsi + ipsi
+        const int block = counts[0]*counts[1]*counts[2];
+        for (int t = 0; t < tilings; t++) {
+            const int* shift = &shifts[3*t];
+            int ix = (q[0] + shift[0]) >> RESOLUTION_BITS;
+            int iy = (q[1] + shift[1]) >> RESOLUTION_BITS;
+            int ipsi = (q[2] + shift[2]) >> RESOLUTION_BITS;
+            if (ipsi == counts[2]) {
+                ipsi = 0;
+            }
+            activate(phi, 4 + (t*TILE_COLORS + color)*block + (ix*counts[1] + iy)*counts[2] + ipsi);
+        }
+    }
+
+    int tilings;
+
+    // Tiles along x, y and psi in every tiling
+    int counts[3];
+
+    // Conversion to fixed point: (s - origin)*scale
+    double origin[3];
+    double scale[3];
+
+    // Largest fixed point position along x and y, and the fixed point turn
+    int limit[3];
+
+    // Fixed point offset of every tiling along x, y and psi
+    std::vector<int> shifts;
+};
+
+/**
+ * Radial-basis functions are placed every 10 units in
+ * in the x and y dimensions and every 30 degrees
+ * @return The centers of the RBF used for the 200x200 rooms map
+ */
+inline Eigen::MatrixXd roomCenters()
+{
+    Eigen::MatrixXd U(5200, 3);
+    int i = 0;
+    for (double x = 10.2/2.0; x < 200; x += 10) {
+        for (double y = 10.2/2.0; y < 200; y += 10) {
+            for (double psi = 0; psi <= 360; psi += 30) {
+                U(i, 0) = x;
+                U(i, 1) = y;
+                U(i, 2) = psi;
+                i += 1;
+            }
+        }
+    }
+    return U;
+}
+
+} // namespace rl
+
+#endif
@@ -26,11 +26,21 @@ protected:
      * @return The Eigen::Vector representation.
      */
     Eigen::VectorXd convertVector(const std::vector<float>& s) {
-        Eigen::VectorXd out(s.size());
+        Eigen::VectorXd out;
+        convertVector(s, out);
+        return out; 
+    }
+
+    /**
+     * Convert an STL vector to an Eigen::Vector of double in place.
+     * @param s The vector to convert
+     * @param out Set to the Eigen::Vector representation, reusing its storage
+     */
+    void convertVector(const std::vector<float>& s, Eigen::VectorXd& out) {
+        out.resize(s.size());
         for (unsigned i = 0; i < s.size(); i++) {
             out(i) = s[i];
         }
-        return out; 
     }
 };
 
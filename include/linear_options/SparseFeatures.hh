@@ -0,0 +1,476 @@
+#ifndef __SPARSE_FEATURES_H__
+#define __SPARSE_FEATURES_H__
+
+#include <vector>
+#include <algorithm>
+#include <Eigen/Core>
+
+namespace rl {
+
+/**
+ * A feature vector for which only the active coordinates are stored,
+ * as two parallel lists of indices and values. An index may appear
+ * more than once, in which case its values are summed. This lets
+ * linear combinations of sparse vectors be formed by appending.
+ */
+struct sparse_features
+{
+    /**
+     * @param dimension The length of the equivalent dense vector
+     */
+    sparse_features(int dimension = 0) : dimension(dimension) {};
+
+    /**
+     * Remove every active coordinate, but keep the allocated storage
+     */
+    void clear()
+    {
+        indices.clear();
+        values.clear();
+    }
+
+    /**
+     * @param i Index of the coordinate
+     * @param v Value of the coordinate
+     */
+    void push_back(int i, double v)
+    {
+        indices.push_back(i);
+        values.push_back(v);
+    }
+
+    /**
+     * @return The number of stored (index, value) pairs
+     */
+    unsigned nonZeros() const { return indices.size(); }
+
+    /**
+     * @param i Index of the coordinate
+     * @return The value of the i-th coordinate of the dense vector
+     */
+    double coeff(int i) const
+    {
+        double v = 0;
+        for (unsigned k = 0; k < indices.size(); k++) {
+            if (indices[k] == i) {
+                v += values[k];
+            }
+        }
+        return v;
+    }
+
+    /**
+     * @return The equivalent dense representation
+     */
+    Eigen::VectorXd toDense() const
+    {
+        Eigen::VectorXd out;
+        toDense(out);
+        return out;
+    }
+
+    /**
+     * @param out Set to the equivalent dense representation, 
+     * reusing its storage
+     */
+    void toDense(Eigen::VectorXd& out) const
+    {
+        out.setZero(dimension);
+        for (unsigned k = 0; k < indices.size(); k++) {
+            out(indices[k]) += values[k];
+        }
+    }
+
+    // Length of the equivalent dense vector
+    int dimension;
+
+    std::vector<int> indices;
+    std::vector<double> values;
+};
+
+/**
+ * @return The sparse representation of a dense vector, 
+ * made of its non-zero coordinates.
+ */
+inline sparse_features toSparse(const Eigen::VectorXd& phi)
+{
+    sparse_features out(phi.size());
+    for (int i = 0; i < phi.size(); i++) {
+        if (phi(i) != 0) {
+            out.push_back(i, phi(i));
+        }
+    }
+    return out;
+}
+
+/**
+ * @return phi, which is already sparse
+ */
+inline const sparse_features& toSparse(const sparse_features& phi)
+{
+    return phi;
+}
+
+/**
+ * A feature vector of zeros and ones, for which only the indices of
+ * the ones are stored. As for sparse_features, an index may appear
+ * more than once, in which case its entry is the number of occurrences.
+ * The kernels only gather and scatter the weights of the active 
+ * features, without multiplying them by the feature values.
+ */
+struct binary_features
+{
+    /**
+     * @param dimension The length of the equivalent dense vector
+     */
+    binary_features(int dimension = 0) : dimension(dimension) {};
+
+    /**
+     * Remove every active coordinate, but keep the allocated storage
+     */
+    void clear() { indices.clear(); }
+
+    /**
+     * @param i Index of a coordinate equal to one
+     */
+    void push_back(int i) { indices.push_back(i); }
+
+    /**
+     * @return The number of stored indices
+     */
+    unsigned nonZeros() const { return indices.size(); }
+
+    /**
+     * @param i Index of the coordinate
+     * @return The value of the i-th coordinate of the dense vector
+     */
+    double coeff(int i) const
+    {
+        return std::count(indices.begin(), indices.end(), i);
+    }
+
+    /**
+     * @return The equivalent dense representation
+     */
+    Eigen::VectorXd toDense() const
+    {
+        Eigen::VectorXd out;
+        toDense(out);
+        return out;
+    }
+
+    /**
+     * @param out Set to the equivalent dense representation, 
+     * reusing its storage
+     */
+    void toDense(Eigen::VectorXd& out) const
+    {
+        out.setZero(dimension);
+        for (unsigned k = 0; k < indices.size(); k++) {
+            out(indices[k]) += 1;
+        }
+    }
+
+    // Length of the equivalent dense vector
+    int dimension;
+
+    std::vector<int> indices;
+};
+
+/**
+ * @param out Set to phi, reusing its storage
+ */
+inline void assign(sparse_features& out, const binary_features& phi)
+{
+    out.dimension = phi.dimension;
+    out.indices = phi.indices;
+    out.values.assign(phi.indices.size(), 1.0);
+}
+
+/**
+ * @param out Set to phi, of the same representation
+ */
+template<class Features>
+inline void assign(Features& out, const Features& phi)
+{
+    out = phi;
+}
+
+/**
+ * @return The sparse representation of phi
+ */
+inline sparse_features toSparse(const binary_features& phi)
+{
+    sparse_features out;
+    assign(out, phi);
+    return out;
+}
+
+/**
+ * Storage for one feature vector of any representation, for code 
+ * written once for all that needs a temporary it can reuse across calls
+ */
+struct features_workspace
+{
+    /**
+     * @return The storage of the same representation as phi
+     */
+    Eigen::VectorXd& like(const Eigen::VectorXd& phi) { return dense; }
+    sparse_features& like(const sparse_features& phi) { return sparse; }
+    binary_features& like(const binary_features& phi) { return binary; }
+
+    /**
+     * @return The storage for linear combinations of vectors such as phi,
+     * which are no longer binary when phi is
+     */
+    Eigen::VectorXd& combination(const Eigen::VectorXd& phi) { return dense; }
+    sparse_features& combination(const sparse_features& phi) { return sparse; }
+    sparse_features& combination(const binary_features& phi) { return sparse; }
+
+    Eigen::VectorXd dense;
+    sparse_features sparse;
+    binary_features binary;
+};
+
+/**
+ * The kernels below are overloaded for dense, sparse and binary feature vectors
+ * so that the learning rules can be written once for every representation.
+ */
+
+/**
+ * @return theta^T phi
+ */
+template<class Derived>
+inline double dot(const Eigen::MatrixBase<Derived>& theta, const Eigen::VectorXd& phi)
+{
+    return theta.dot(phi);
+}
+
+/**
+ * @return theta^T phi, reading only the active coordinates of phi
+ */
+template<class Derived>
+inline double dot(const Eigen::MatrixBase<Derived>& theta, const sparse_features& phi)
+{
+    double out = 0;
+    for (unsigned k = 0; k < phi.indices.size(); k++) {
+        out += theta(phi.indices[k])*phi.values[k];
+    }
+    return out;
+}
+
+/**
+ * @return theta^T phi, the sum of the weights of the active features
+ */
+template<class Derived>
+inline double dot(const Eigen::MatrixBase<Derived>& theta, const binary_features& phi)
+{
+    double out = 0;
+    for (unsigned k = 0; k < phi.indices.size(); k++) {
+        out += theta(phi.indices[k]);
+    }
+    return out;
+}
+
+/**
+ * In-place update y <- y + a*x. 
+ * y may be a block, such as a column of a matrix, hence the const_cast
+ * which is the usual way of writing to Eigen expressions.
+ */
+template<class Derived, class OtherDerived>
+inline void axpy(double a, const Eigen::MatrixBase<OtherDerived>& x, const Eigen::MatrixBase<Derived>& y)
+{
+    const_cast<Eigen::MatrixBase<Derived>&>(y) += a*x;
+}
+
+/**
+ * In-place update y <- y + a*x, touching only the active coordinates of x
+ */
+template<class Derived>
+inline void axpy(double a, const sparse_features& x, const Eigen::MatrixBase<Derived>& y)
+{
+    Eigen::MatrixBase<Derived>& out = const_cast<Eigen::MatrixBase<Derived>&>(y);
+    for (unsigned k = 0; k < x.indices.size(); k++) {
+        out(x.indices[k]) += a*x.values[k];
+    }
+}
+
+/**
+ * In-place update y <- y + a*x, adding a to the active coordinates of x
+ */
+template<class Derived>
+inline void axpy(double a, const binary_features& x, const Eigen::MatrixBase<Derived>& y)
+{
+    Eigen::MatrixBase<Derived>& out = const_cast<Eigen::MatrixBase<Derived>&>(y);
+    for (unsigned k = 0; k < x.indices.size(); k++) {
+        out(x.indices[k]) += a;
+    }
+}
+
+/**
+ * In-place update y <- y + a*x where both vectors are sparse.
+ * The entries of x are appended to y.
+ */
+inline void axpy(double a, const sparse_features& x, sparse_features& y)
+{
+    for (unsigned k = 0; k < x.indices.size(); k++) {
+        y.push_back(x.indices[k], a*x.values[k]);
+    }
+}
+
+/**
+ * In-place update y <- y + a*x, appending the entries of x to y
+ */
+inline void axpy(double a, const binary_features& x, sparse_features& y)
+{
+    for (unsigned k = 0; k < x.indices.size(); k++) {
+        y.push_back(x.indices[k], a);
+    }
+}
+
+/**
+ * The products come in two forms: returning a new vector, or writing
+ * into a vector whose storage is reused when it has the right size.
+ */
+
+/**
+ * @param out Set to the matrix-vector product F*phi
+ */
+inline void product(const Eigen::MatrixXd& F, const Eigen::VectorXd& phi, Eigen::VectorXd& out)
+{
+    out.noalias() = F*phi;
+}
+
+/**
+ * @param out Set to the matrix-vector product F*phi, reading only 
+ * the columns of F for the active coordinates of phi.
+ */
+inline void product(const Eigen::MatrixXd& F, const sparse_features& phi, Eigen::VectorXd& out)
+{
+    out.setZero(F.rows());
+    for (unsigned k = 0; k < phi.indices.size(); k++) {
+        out += phi.values[k]*F.col(phi.indices[k]);
+    }
+}
+
+/**
+ * @param out Set to the matrix-vector product F*phi, the sum of  
+ * the columns of F for the active coordinates of phi.
+ */
+inline void product(const Eigen::MatrixXd& F, const binary_features& phi, Eigen::VectorXd& out)
+{
+    out.setZero(F.rows());
+    for (unsigned k = 0; k < phi.indices.size(); k++) {
+        out += F.col(phi.indices[k]);
+    }
+}
+
+/**
+ * @return The matrix-vector product F*phi
+ */
+template<class Features>
+inline Eigen::VectorXd product(const Eigen::MatrixXd& F, const Features& phi)
+{
+    Eigen::VectorXd out;
+    product(F, phi, out);
+    return out;
+}
+
+/**
+ * @param out Set to the matrix-vector product W^T*phi, one entry per column of W
+ */
+inline void transposeProduct(const Eigen::MatrixXd& W, const Eigen::VectorXd& phi, Eigen::VectorXd& out)
+{
+    out.noalias() = W.transpose()*phi;
+}
+
+/**
+ * @param out Set to the matrix-vector product W^T*phi, reading only 
+ * the rows of W for the active coordinates of phi.
+ */
+inline void transposeProduct(const Eigen::MatrixXd& W, const sparse_features& phi, Eigen::VectorXd& out)
+{
+    out.setZero(W.cols());
+    for (unsigned k = 0; k < phi.indices.size(); k++) {
+        out += phi.values[k]*W.row(phi.indices[k]).transpose();
+    }
+}
+
+/**
+ * @param out Set to the matrix-vector product W^T*phi, the sum of 
+ * the rows of W for the active coordinates of phi.
+ */
+inline void transposeProduct(const Eigen::MatrixXd& W, const binary_features& phi, Eigen::VectorXd& out)
+{
+    out.setZero(W.cols());
+    for (unsigned k = 0; k < phi.indices.size(); k++) {
+        out += W.row(phi.indices[k]).transpose();
+    }
+}
+
+/**
+ * @return The matrix-vector product W^T*phi, one entry per column of W
+ */
+template<class Features>
+inline Eigen::VectorXd transposeProduct(const Eigen::MatrixXd& W, const Features& phi)
+{
+    Eigen::VectorXd out;
+    transposeProduct(W, phi, out);
+    return out;
+}
+
+/**
+ * Rank-one update F <- F + a*u*v^T
+ */
+inline void rankUpdate(double a, const Eigen::VectorXd& u, const Eigen::VectorXd& v, Eigen::MatrixXd& F)
+{
+    F.noalias() += a*u*v.transpose();
+}
+
+/**
+ * Rank-one update F <- F + a*u*v^T, touching only the columns of F
+ * for the active coordinates of v.
+ */
+inline void rankUpdate(double a, const Eigen::VectorXd& u, const sparse_features& v, Eigen::MatrixXd& F)
+{
+    for (unsigned k = 0; k < v.indices.size(); k++) {
+        F.col(v.indices[k]) += (a*v.values[k])*u;
+    }
+}
+
+/**
+ * Rank-one update F <- F + a*u*v^T, touching only the rows of F
+ * for the active coordinates of u.
+ */
+inline void rankUpdate(double a, const sparse_features& u, const Eigen::VectorXd& v, Eigen::MatrixXd& F)
+{
+    for (unsigned k = 0; k < u.indices.size(); k++) {
+        F.row(u.indices[k]) += (a*u.values[k])*v.transpose();
+    }
+}
+
+/**
+ * Rank-one update F <- F + a*u*v^T, adding a*u to the columns 
+ * of F for the active coordinates of v.
+ */
+inline void rankUpdate(double a, const Eigen::VectorXd& u, const binary_features& v, Eigen::MatrixXd& F)
+{
+    for (unsigned k = 0; k < v.indices.size(); k++) {
+        F.col(v.indices[k]) += a*u;
+    }
+}
+
+/**
+ * Rank-one update F <- F + a*u*v^T, adding a*v^T to the rows
+ * of F for the active coordinates of u.
+ */
+inline void rankUpdate(double a, const binary_features& u, const Eigen::VectorXd& v, Eigen::MatrixXd& F)
+{
+    for (unsigned k = 0; k < u.indices.size(); k++) {
+        F.row(u.indices[k]) += a*v.transpose();
+    }
+}
+
+} // namespace rl
+
+#endif
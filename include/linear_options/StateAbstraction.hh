@@ -1,6 +1,7 @@
 #ifndef __STATE_ABSTRACTION_H__ 
 #define __STATE_ABSTRACTION_H__
 
+#include <linear_options/SparseFeatures.hh>
 #include <Eigen/Core>
 
 namespace rl {
@@ -8,12 +9,108 @@ namespace rl {
     {
         virtual Eigen::VectorXd operator()(const Eigen::VectorXd& s) = 0;
         virtual int length() = 0;
+
+        /**
+         * Project in place
+         * @param s The input state
+         * @param phi Set to the features of s. Implementations 
+         * reuse its storage when it has the right size.
+         */
+        virtual void project(const Eigen::VectorXd& s, Eigen::VectorXd& phi) { phi = (*this)(s); }
+
+        /**
+         * Forget any state kept from one projection to the next, 
+         * at the start of an episode
+         */
+        virtual void reset() {}
+
+        /**
+         * Project many states at once
+         * @param states The input states, one per column
+         * @param phi Resized to length() x states.cols() if needed and set
+         * to the features of every state, one per column
+         */
+        virtual void projectBatch(const Eigen::MatrixXd& states, Eigen::MatrixXd& phi)
+        {
+            phi.resize(length(), states.cols());
+            for (int i = 0; i < states.cols(); i++) {
+                phi.col(i) = (*this)(states.col(i));
+            }
+        }
     };
 
     struct no_abstraction : public state_abstraction
     {
         Eigen::VectorXd operator()(const Eigen::VectorXd& s) { return s; }
         int length() { return 0; }
+
+        /**
+         * @Override
+         */
+        void project(const Eigen::VectorXd& s, Eigen::VectorXd& phi) { phi = s; }
+
+        /**
+         * @Override
+         */
+        void projectBatch(const Eigen::MatrixXd& states, Eigen::MatrixXd& phi) { phi = states; }
+    };
+
+    /**
+     * A state abstraction for which most of the features are zero
+     * in any given state. The learners detect this interface and
+     * switch to kernels that only touch the active coordinates.
+     */
+    struct sparse_state_abstraction : public state_abstraction
+    {
+        using state_abstraction::project;
+
+        /**
+         * @param s The input state
+         * @param phi Output list of the active (index, value) pairs
+         */
+        virtual void project(const Eigen::VectorXd& s, sparse_features& phi) = 0;
+
+        /**
+         * @Override
+         */
+        Eigen::VectorXd operator()(const Eigen::VectorXd& s)
+        {
+            sparse_features phi(length());
+            project(s, phi);
+            return phi.toDense();
+        }
+
+        /**
+         * @Override
+         */
+        void projectBatch(const Eigen::MatrixXd& states, Eigen::MatrixXd& phi)
+        {
+            phi.setZero(length(), states.cols());
+            sparse_features active(length());
+            for (int i = 0; i < states.cols(); i++) {
+                project(states.col(i), active);
+                // Repeated indices add up, as in sparse_features::toDense
+                for (unsigned k = 0; k < active.indices.size(); k++) {
+                    phi(active.indices[k], i) += active.values[k];
+                }
+            }
+        }
+    };
+
+    /**
+     * A sparse state abstraction whose active features are all equal
+     * to one. The learners detect this interface and switch to kernels
+     * that only gather and scatter the weights of the active features.
+     */
+    struct binary_state_abstraction : public sparse_state_abstraction
+    {
+        using sparse_state_abstraction::project;
+
+        /**
+         * @param s The input state
+         * @param phi Output list of the indices of the active features
+         */
+        virtual void project(const Eigen::VectorXd& s, binary_features& phi) = 0;
     };
 }
 
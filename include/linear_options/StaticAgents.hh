@@ -0,0 +1,595 @@
+#ifndef __STATIC_AGENTS_H__
+#define __STATIC_AGENTS_H__
+
+#include <linear_options/StateAbstraction.hh>
+#include <linear_options/SparseFeatures.hh>
+#include <linear_options/ActionValues.hh>
+#include <linear_options/Option.hh>
+#include <linear_options/serialization.hh>
+#include <rl_common/core.hh>
+#include <rl_common/Random.h>
+
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+#include <Eigen/Core>
+#include <boost/serialization/vector.hpp>
+
+namespace rl {
+
+/**
+ * The representation of the features emitted by an abstraction type:
+ * binary, sparse or dense, the cheapest it supports.
+ */
+template<class Abstraction>
+struct features_of
+{
+    typedef typename std::conditional<std::is_base_of<binary_state_abstraction, Abstraction>::value, binary_features,
+            typename std::conditional<std::is_base_of<sparse_state_abstraction, Abstraction>::value, sparse_features,
+            Eigen::VectorXd>::type>::type type;
+};
+
+/**
+ * Weights of the static agents, one row per feature holding the weights of
+ * every action or option, padded to whole SIMD registers as in
+ * padded_action_values. The values of a state are accumulated one row
+ * per active feature, in lanes of the scalar type.
+ */
+template<class Scalar>
+struct static_weights
+{
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> matrix;
+    typedef Eigen::Matrix<Scalar, 1, Eigen::Dynamic, Eigen::RowMajor, 1, padded_action_values::MAX_ACTIONS> values;
+
+    /**
+     * @param n The number of features
+     * @param columns The number of actions or options, at most MAX_ACTIONS
+     * @return Zero weights with padded rows
+     */
+    static matrix zero(int n, int columns)
+    {
+        if (columns > padded_action_values::MAX_ACTIONS) {
+            throw std::invalid_argument("Too many actions for the static agents");
+        }
+        const int padding = padded_action_values::PADDING;
+        return matrix::Zero(n, (columns + padding - 1)/padding*padding);
+    }
+};
+
+/**
+ * @param q Set to W^T*phi, one entry per column of W
+ */
+template<class Matrix, class Values>
+inline void gatherRows(const Matrix& W, const binary_features& phi, Values& q)
+{
+    q.setZero(W.cols());
+    for (unsigned k = 0; k < phi.indices.size(); k++) {
+        q += W.row(phi.indices[k]);
+    }
+}
+
+template<class Matrix, class Values>
+inline void gatherRows(const Matrix& W, const sparse_features& phi, Values& q)
+{
+    typedef typename Matrix::Scalar Scalar;
+    q.setZero(W.cols());
+    for (unsigned k = 0; k < phi.indices.size(); k++) {
+        q += Scalar(phi.values[k])*W.row(phi.indices[k]);
+    }
+}
+
+template<class Matrix, class Values>
+inline void gatherRows(const Matrix& W, const Eigen::VectorXd& phi, Values& q)
+{
+    typedef typename Matrix::Scalar Scalar;
+    q.setZero(W.cols());
+    for (int j = 0; j < phi.size(); j++) {
+        if (phi(j) != 0) {
+            q += Scalar(phi(j))*W.row(j);
+        }
+    }
+}
+
+/**
+ * @return Column j of W^T*phi
+ */
+template<class Matrix>
+inline double columnDot(const Matrix& W, int j, const binary_features& phi)
+{
+    typename Matrix::Scalar out = 0;
+    for (unsigned k = 0; k < phi.indices.size(); k++) {
+        out += W(phi.indices[k], j);
+    }
+    return out;
+}
+
+template<class Matrix>
+inline double columnDot(const Matrix& W, int j, const sparse_features& phi)
+{
+    typedef typename Matrix::Scalar Scalar;
+    Scalar out = 0;
+    for (unsigned k = 0; k < phi.indices.size(); k++) {
+        out += W(phi.indices[k], j)*Scalar(phi.values[k]);
+    }
+    return out;
+}
+
+template<class Matrix>
+inline double columnDot(const Matrix& W, int j, const Eigen::VectorXd& phi)
+{
+    return W.col(j).dot(phi.cast<typename Matrix::Scalar>());
+}
+
+/**
+ * In-place update of column j of W by a*phi
+ */
+template<class Matrix>
+inline void columnUpdate(double a, const binary_features& phi, int j, Matrix& W)
+{
+    typedef typename Matrix::Scalar Scalar;
+    for (unsigned k = 0; k < phi.indices.size(); k++) {
+        W(phi.indices[k], j) += Scalar(a);
+    }
+}
+
+template<class Matrix>
+inline void columnUpdate(double a, const sparse_features& phi, int j, Matrix& W)
+{
+    typedef typename Matrix::Scalar Scalar;
+    for (unsigned k = 0; k < phi.indices.size(); k++) {
+        W(phi.indices[k], j) += Scalar(a*phi.values[k]);
+    }
+}
+
+template<class Matrix>
+inline void columnUpdate(double a, const Eigen::VectorXd& phi, int j, Matrix& W)
+{
+    typedef typename Matrix::Scalar Scalar;
+    W.col(j) += Scalar(a)*phi.cast<Scalar>();
+}
+
+/**
+ * Same learning rule as LinearQ0Learner, resolved at compile time. The
+ * abstraction is called by its static type, which lets the compiler
+ * inline the projection into the step, the features are in the cheapest
+ * representation the abstraction supports, and the weights and action
+ * values are in the scalar type, float to fill twice as many SIMD lanes.
+ *
+ * Tight loops call the overloads taking the state as an Eigen vector,
+ * which are not virtual. The Agent interface is kept as a thin adapter
+ * over them. With double weights, the steps are the same as those of
+ * LinearQ0Learner for the same random number stream.
+ */
+template<class Abstraction, class Scalar = double>
+class StaticLinearQ0Learner : public Agent
+{
+public:
+    typedef typename features_of<Abstraction>::type features_type;
+    typedef typename static_weights<Scalar>::matrix weight_matrix;
+    typedef typename static_weights<Scalar>::values value_vector;
+
+    StaticLinearQ0Learner(unsigned numActions, double alpha, double epsilon, double gamma, Abstraction& abstraction, Random rng = Random()) :
+        weights(static_weights<Scalar>::zero(abstraction.length(), numActions)),
+        numActions(numActions),
+        alpha(alpha),
+        epsilon(epsilon),
+        gamma(gamma),
+        abstraction(&abstraction),
+        rng(rng) {};
+
+    /**
+     * @param s The initial state
+     * @return The first action
+     */
+    int first_action(const Eigen::VectorXd& s)
+    {
+        abstraction->Abstraction::reset();
+        project(s, phi);
+        return epsilonGreedy();
+    }
+
+    /**
+     * @param r The reward of the last action
+     * @param s The current state
+     * @return The next action
+     */
+    int next_action(double r, const Eigen::VectorXd& s)
+    {
+        project(s, phi);
+        gatherRows(weights, phi, actionValues);
+        tdUpdate(r + gamma*actionValues.head(numActions).maxCoeff());
+        return epsilonGreedy();
+    }
+
+    /**
+     * @param r The reward received in the terminal state
+     */
+    void last(double r) { tdUpdate(r); }
+
+    /**
+     * @Override
+     */
+    int first_action(const std::vector<float>& s) { return first_action(convert(s)); }
+
+    /**
+     * @Override
+     */
+    int next_action(float r, const std::vector<float>& s) { return next_action(double(r), convert(s)); }
+
+    /**
+     * @Override
+     */
+    void last_action(float r) { last(r); }
+
+    /**
+     * @Override
+     */
+    void setDebug(bool d) {}
+
+    /**
+     * @return The weights of the pseudo-Q-function in double precision, one column per action
+     */
+    Eigen::MatrixXd getActionValueThetas() const
+    {
+        return weights.leftCols(numActions).template cast<double>();
+    }
+
+    /**
+     * Save the parameter vectors for every action,
+     * in the text format of LinearQ0Learner::savePolicy
+     * @param filename The path to the file containing the theta parameters for every action
+     */
+    void savePolicy(const std::string& filename)
+    {
+        std::ofstream file(filename);
+        boost::archive::text_oarchive oa(file);
+        const std::vector<Eigen::VectorXd> thetas = columns(getActionValueThetas());
+        oa << thetas;
+    }
+
+private:
+    void project(const Eigen::VectorXd& s, features_type& out)
+    {
+        abstraction->Abstraction::project(s, out);
+    }
+
+    const Eigen::VectorXd& convert(const std::vector<float>& s)
+    {
+        state.resize(s.size());
+        for (unsigned i = 0; i < s.size(); i++) {
+            state(i) = s[i];
+        }
+        return state;
+    }
+
+    /**
+     * Choose an action in phi, which becomes the last state
+     */
+    int epsilonGreedy()
+    {
+        if (rng.uniform() < epsilon) {
+            lastAction = rng.uniformDiscrete(0, numActions - 1);
+        } else {
+            gatherRows(weights, phi, actionValues);
+            actionValues.head(numActions).maxCoeff(&lastAction);
+        }
+        std::swap(lastPhi, phi);
+        return lastAction;
+    }
+
+    void tdUpdate(double target)
+    {
+        columnUpdate(alpha*(target - columnDot(weights, lastAction, lastPhi)), lastPhi, lastAction, weights);
+    }
+
+    weight_matrix weights;
+
+    unsigned numActions;
+    double alpha;
+    double epsilon;
+    double gamma;
+    Abstraction* abstraction;
+    Random rng;
+
+    int lastAction;
+    features_type lastPhi;
+
+    // Storage reused by every step
+    Eigen::VectorXd state;
+    features_type phi;
+    value_vector actionValues;
+};
+
+/**
+ * Terminates option o where its indicator feature is active, as the
+ * options reaching the rooms of every color
+ */
+struct indicator_termination
+{
+    /**
+     * @param indicators The index of the indicator feature of every option
+     */
+    indicator_termination(const std::vector<int>& indicators) : indicators(indicators) {};
+
+    template<class Features>
+    double operator()(unsigned o, const Features& phi) const
+    {
+        return phi.coeff(indicators[o]) ? 1 : 0;
+    }
+
+    std::vector<int> indicators;
+};
+
+/**
+ * An SMDP agent executing fixed linear options, with the option values
+ * learnt by intra-option Q-learning: after every primitive step, every
+ * option whose greedy action was the one taken moves towards
+ *   r + gamma*((1 - beta_o(phi'))*Q(phi', o) + beta_o(phi')*max Q(phi', .))
+ * The abstraction, the termination functor and the scalar type are
+ * resolved at compile time as in StaticLinearQ0Learner, with the policies
+ * of all the options and their values in padded row-major weights.
+ */
+template<class Abstraction, class Termination, class Scalar = double>
+class StaticLOEMAgent : public Agent
+{
+public:
+    typedef typename features_of<Abstraction>::type features_type;
+    typedef typename static_weights<Scalar>::matrix weight_matrix;
+    typedef typename static_weights<Scalar>::values value_vector;
+
+    /**
+     * @param options The options to execute, whose policies and values are copied
+     * @param termination Evaluates beta_o(phi) for every option o
+     */
+    StaticLOEMAgent(const std::vector<LinearOption*>& options, double alpha, double epsilon, double gamma, Abstraction& abstraction, const Termination& termination, Random rng = Random()) :
+        numOptions(options.size()),
+        alpha(alpha),
+        epsilon(epsilon),
+        gamma(gamma),
+        abstraction(&abstraction),
+        termination(termination),
+        rng(rng)
+    {
+        const int n = abstraction.length();
+        thetas = static_weights<Scalar>::zero(n, numOptions);
+        for (unsigned o = 0; o < numOptions; o++) {
+            const Eigen::MatrixXd& policy = options[o]->getActionValueThetas();
+            policies.push_back(static_weights<Scalar>::zero(n, policy.cols()));
+            policies[o].leftCols(policy.cols()) = policy.cast<Scalar>();
+            numActions.push_back(policy.cols());
+            if (options[o]->theta.size() == n) {
+                thetas.col(o) = options[o]->theta.cast<Scalar>();
+            }
+        }
+        greedyActions.resize(numOptions);
+        lastGreedyActions.resize(numOptions);
+    }
+
+    /**
+     * @param s The initial state
+     * @return The first action
+     */
+    int first_action(const Eigen::VectorXd& s)
+    {
+        abstraction->Abstraction::reset();
+        project(s, phi);
+        gatherRows(thetas, phi, optionValues);
+        currentOption = bestOption();
+        return act();
+    }
+
+    /**
+     * @param r The reward of the last action
+     * @param s The current state
+     * @return The next action
+     */
+    int next_action(double r, const Eigen::VectorXd& s)
+    {
+        project(s, phi);
+        gatherRows(thetas, phi, optionValues);
+        const double maxValue = optionValues.head(numOptions).maxCoeff();
+
+        for (unsigned o = 0; o < numOptions; o++) {
+            if (lastGreedyActions[o] != lastAction) {
+                continue;
+            }
+            double beta = termination(o, phi);
+            double target = r + gamma*((1 - beta)*optionValues(o) + beta*maxValue);
+            columnUpdate(alpha*(target - columnDot(thetas, o, lastPhi)), lastPhi, o, thetas);
+        }
+
+        if (rng.uniform() < termination(currentOption, phi)) {
+            currentOption = bestOption();
+        }
+        return act();
+    }
+
+    /**
+     * @param r The reward received in the terminal state
+     */
+    void last(double r)
+    {
+        for (unsigned o = 0; o < numOptions; o++) {
+            if (lastGreedyActions[o] == lastAction) {
+                columnUpdate(alpha*(r - columnDot(thetas, o, lastPhi)), lastPhi, o, thetas);
+            }
+        }
+    }
+
+    /**
+     * @Override
+     */
+    int first_action(const std::vector<float>& s) { return first_action(convert(s)); }
+
+    /**
+     * @Override
+     */
+    int next_action(float r, const std::vector<float>& s) { return next_action(double(r), convert(s)); }
+
+    /**
+     * @Override
+     */
+    void last_action(float r) { last(r); }
+
+    /**
+     * @Override
+     */
+    void setDebug(bool d) {}
+
+    /**
+     * @return The value function weights of the options in double precision, one column per option
+     */
+    Eigen::MatrixXd getThetas() const
+    {
+        return thetas.leftCols(numOptions).template cast<double>();
+    }
+
+private:
+    void project(const Eigen::VectorXd& s, features_type& out)
+    {
+        abstraction->Abstraction::project(s, out);
+    }
+
+    const Eigen::VectorXd& convert(const std::vector<float>& s)
+    {
+        state.resize(s.size());
+        for (unsigned i = 0; i < s.size(); i++) {
+            state(i) = s[i];
+        }
+        return state;
+    }
+
+    /**
+     * @return An option drawn epsilon-greedily from the option values in phi
+     */
+    unsigned bestOption()
+    {
+        if (rng.uniform() < epsilon) {
+            return rng.uniformDiscrete(0, numOptions - 1);
+        }
+        int best = 0;
+        optionValues.head(numOptions).maxCoeff(&best);
+        return best;
+    }
+
+    /**
+     * Find the greedy action of every option in phi, which
+     * becomes the last state, and follow the current option
+     */
+    int act()
+    {
+        for (unsigned o = 0; o < numOptions; o++) {
+            gatherRows(policies[o], phi, actionValues);
+            actionValues.head(numActions[o]).maxCoeff(&greedyActions[o]);
+        }
+        std::swap(lastGreedyActions, greedyActions);
+        std::swap(lastPhi, phi);
+
+        lastAction = lastGreedyActions[currentOption];
+        return lastAction;
+    }
+
+    // Fixed policies of the options, and the number of actions of each
+    std::vector<weight_matrix> policies;
+    std::vector<int> numActions;
+
+    // Value function weights, one column per option
+    weight_matrix thetas;
+
+    unsigned numOptions;
+    double alpha;
+    double epsilon;
+    double gamma;
+    Abstraction* abstraction;
+    Termination termination;
+    Random rng;
+
+    unsigned currentOption;
+    int lastAction;
+    features_type lastPhi;
+
+    // Greedy action of every option in phi and in lastPhi
+    std::vector<int> greedyActions;
+    std::vector<int> lastGreedyActions;
+
+    // Storage reused by every step
+    Eigen::VectorXd state;
+    features_type phi;
+    value_vector optionValues;
+    value_vector actionValues;
+};
+
+/**
+ * The pseudo-reward of RewardDecorator, resolved at compile time. The
+ * shaping type provides pseudoReward(r, s) and terminal(s) over the state
+ * as an Eigen vector, and both are inlined into the step of the learner,
+ * which is called by its static type. The Agent interface converts
+ * the state once and is kept as a thin adapter.
+ */
+template<class Learner, class Shaping>
+class StaticRewardDecorator : public Agent
+{
+public:
+    /**
+     * @param learner The learner that we wish to shield from the actual reward function
+     * @param shaping The pseudo-reward function and its terminal states
+     */
+    StaticRewardDecorator(Learner& learner, const Shaping& shaping) : learner(&learner), shaping(shaping) {};
+
+    Learner* getAgent() { return learner; }
+
+    int first_action(const Eigen::VectorXd& s) { return learner->first_action(s); }
+
+    int next_action(double r, const Eigen::VectorXd& s) { return learner->next_action(shaping.pseudoReward(r, s), s); }
+
+    void last(double r) { learner->last(r); }
+
+    bool terminal(const Eigen::VectorXd& s) const { return shaping.terminal(s); }
+
+    /**
+     * @Override
+     */
+    int first_action(const std::vector<float>& s) { return first_action(convert(s)); }
+
+    /**
+     * @Override
+     */
+    int next_action(float r, const std::vector<float>& s) { return next_action(double(r), convert(s)); }
+
+    /**
+     * @Override
+     */
+    void last_action(float r) { last(r); }
+
+    /**
+     * @Override
+     */
+    void setDebug(bool d) { learner->setDebug(d); }
+
+    /**
+     * @param s The current state
+     * @return True in the terminal states of the pseudo-reward function
+     */
+    bool terminal(const std::vector<float>& s) { return terminal(convert(s)); }
+
+private:
+    const Eigen::VectorXd& convert(const std::vector<float>& s)
+    {
+        state.resize(s.size());
+        for (unsigned i = 0; i < s.size(); i++) {
+            state(i) = s[i];
+        }
+        return state;
+    }
+
+    Learner* learner;
+    Shaping shaping;
+
+    // Last input state, kept to reuse its storage
+    Eigen::VectorXd state;
+};
+
+} // namespace rl
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef __SWEEP_QUEUE_H__
+#define __SWEEP_QUEUE_H__
+
+#include <linear_options/SparseFeatures.hh>
+
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <utility>
+#include <mutex>
+#include <Eigen/Core>
+
+namespace rl {
+
+/**
+ * Priority queue over the features for prioritized sweeping.
+ * The priority of a feature is the largest change recently made to
+ * the value of a feature that it leads to. Features with a priority
+ * below the threshold are never queued. Safe to share between threads.
+ *
+ * Priorities are updated lazily: raising a feature pushes a new entry,
+ * and the outdated entries are skipped when they reach the top.
+ * The heap is a vector which keeps its storage when it is compacted.
+ */
+class SweepQueue
+{
+public:
+    /**
+     * @param n The number of features
+     * @param threshold The smallest priority worth planning for
+     */
+    SweepQueue(unsigned n = 0, double threshold = 0) { reset(n, threshold); }
+
+    /**
+     * Empty the queue
+     * @param n The number of features
+     * @param threshold The smallest priority worth planning for
+     */
+    void reset(unsigned n, double threshold)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        priorities.assign(n, 0);
+        heap.clear();
+        this->threshold = threshold;
+    }
+
+    /**
+     * Raise the priority of every feature i to at least scale*|phi_i|
+     * @param scale The magnitude of the change
+     * @param phi The dependency of each feature on the change
+     */
+    void raise(double scale, const Eigen::VectorXd& phi)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < phi.size(); i++) {
+            push(i, scale*std::fabs(phi(i)));
+        }
+        compact();
+    }
+
+    /**
+     * Raise the priority of every active feature i to at least scale*|phi_i|
+     * @param scale The magnitude of the change
+     * @param phi The dependency of each active feature on the change
+     */
+    void raise(double scale, const sparse_features& phi)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (unsigned k = 0; k < phi.indices.size(); k++) {
+            push(phi.indices[k], scale*std::fabs(phi.values[k]));
+        }
+        compact();
+    }
+
+    /**
+     * Raise the priority of every active binary feature to at least scale
+     * @param scale The magnitude of the change
+     * @param phi The features depending on the change
+     */
+    void raise(double scale, const binary_features& phi)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (unsigned k = 0; k < phi.indices.size(); k++) {
+            push(phi.indices[k], std::fabs(scale));
+        }
+        compact();
+    }
+
+    /**
+     * Remove the feature of highest priority
+     * @param i Set to the feature of highest priority
+     * @return False if no feature is above the threshold
+     */
+    bool pop(unsigned& i)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (!heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end());
+            entry top = heap.back();
+            heap.pop_back();
+            if (priorities[top.second] == top.first) {
+                priorities[top.second] = 0;
+                i = top.second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    typedef std::pair<double, unsigned> entry;
+
+    void push(unsigned i, double priority)
+    {
+        if (priority > threshold && priority > priorities[i]) {
+            priorities[i] = priority;
+            heap.push_back(entry(priority, i));
+            std::push_heap(heap.begin(), heap.end());
+        }
+    }
+
+    /**
+     * Drop the outdated entries once they outnumber the features
+     */
+    void compact()
+    {
+        if (heap.size() <= 4*priorities.size()) {
+            return;
+        }
+
+        heap.clear();
+        for (unsigned i = 0; i < priorities.size(); i++) {
+            if (priorities[i] > 0) {
+                heap.push_back(entry(priorities[i], i));
+            }
+        }
+        std::make_heap(heap.begin(), heap.end());
+    }
+
+    // Current priority of every feature, 0 when not queued
+    std::vector<double> priorities;
+    // Max-heap of the (priority, feature) entries
+    std::vector<entry> heap;
+    double threshold;
+    std::mutex mutex;
+};
+
+} // namespace rl
+
+#endif
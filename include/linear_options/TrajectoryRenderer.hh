@@ -0,0 +1,73 @@
+#ifndef __TRAJECTORY_RENDERER_H__
+#define __TRAJECTORY_RENDERER_H__
+
+#include <opencv/cv.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * Draws the trajectories of sampled episodes on a background thread,
+ * so that no rendering happens in the sense-act loop. Trajectories are
+ * handed over through a bounded queue. When the queue is full the
+ * episode is dropped rather than blocking the learner.
+ */
+class TrajectoryRenderer
+{
+public:
+    /**
+     * @param background The image on which the trajectories are drawn
+     * @param filenamePrefix Episode i is written to <filenamePrefix>i.png
+     * @param every Render one out of every N episodes
+     * @param capacity Maximum number of trajectories waiting to be drawn
+     */
+    TrajectoryRenderer(const cv::Mat& background, const std::string& filenamePrefix, unsigned every, unsigned capacity = 16);
+
+    /**
+     * Draw the trajectories left in the queue and stop the rendering thread
+     */
+    ~TrajectoryRenderer();
+
+    /**
+     * @param episode Index of the episode
+     * @return true if the trajectory of this episode should be recorded
+     */
+    bool sampled(unsigned episode) const { return every > 0 && episode % every == 0; }
+
+    /**
+     * Hand over a trajectory to the rendering thread. 
+     * @param episode Index of the episode
+     * @param trajectory Successive positions of the robot, emptied on return
+     * @return false if the queue was full and the trajectory was dropped
+     */
+    bool push(unsigned episode, std::vector<cv::Point>& trajectory);
+
+private:
+    /**
+     * Main loop of the rendering thread
+     */
+    void run();
+
+    struct Episode {
+        unsigned index;
+        std::vector<cv::Point> trajectory;
+    };
+
+    cv::Mat background;
+    std::string filenamePrefix;
+    unsigned every;
+    unsigned capacity;
+
+    std::deque<Episode> queue;
+    std::mutex mutex;
+    std::condition_variable available;
+    bool done;
+
+    std::thread worker;
+};
+
+#endif
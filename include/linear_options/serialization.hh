@@ -1,6 +1,8 @@
 #ifndef __SERIALIZATION_H__
 #define __SERIALIZATION_H__
 
+#include <vector>
+#include <stdexcept>
 #include <Eigen/Core>
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
@@ -72,4 +74,37 @@ void serialize( Archive & ar,
 } // namespace serialization
 } // namespace boost
 
+namespace rl {
+/**
+ * The text archives store action-value weights as one vector per action.
+ * @param m A matrix with one column per action
+ * @return The columns of m
+ */
+inline std::vector<Eigen::VectorXd> columns(const Eigen::MatrixXd& m)
+{
+    std::vector<Eigen::VectorXd> out(m.cols());
+    for (unsigned i = 0; i < out.size(); i++) {
+        out[i] = m.col(i);
+    }
+    return out;
+}
+
+/**
+ * @param vectors One vector per action, all of the same length
+ * @return A matrix with one column per action
+ * @throw std::runtime_error If the vectors do not all have the same length
+ */
+inline Eigen::MatrixXd fromColumns(const std::vector<Eigen::VectorXd>& vectors)
+{
+    Eigen::MatrixXd out(vectors.empty() ? 0 : vectors[0].size(), vectors.size());
+    for (unsigned i = 0; i < vectors.size(); i++) {
+        if (vectors[i].size() != out.rows()) {
+            throw std::runtime_error("Columns of different lengths in archive");
+        }
+        out.col(i) = vectors[i];
+    }
+    return out;
+}
+} // namespace rl
+
 #endif
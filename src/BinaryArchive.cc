@@ -0,0 +1,130 @@
+#include <linear_options/BinaryArchive.hh>
+
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace rl;
+
+/**
+ * @return The smallest multiple of BINARY_ALIGNMENT greater or equal to offset
+ */
+static uint64_t align(uint64_t offset)
+{
+    return (offset + BINARY_ALIGNMENT - 1)/BINARY_ALIGNMENT*BINARY_ALIGNMENT;
+}
+
+void rl::saveBinary(const std::string& filename, uint32_t kind, const std::vector<binary_array>& arrays)
+{
+    binary_header header;
+    std::memcpy(header.magic, BINARY_MAGIC, sizeof(header.magic));
+    header.version = BINARY_VERSION;
+    header.kind = kind;
+    header.count = arrays.size();
+
+    // Lay out the arrays after the header and the table of entries
+    std::vector<binary_entry> entries(arrays.size());
+    uint64_t offset = sizeof(binary_header) + arrays.size()*sizeof(binary_entry);
+    for (unsigned i = 0; i < arrays.size(); i++) {
+        offset = align(offset);
+        entries[i].rows = arrays[i].rows;
+        entries[i].cols = arrays[i].cols;
+        entries[i].offset = offset;
+        offset += arrays[i].rows*arrays[i].cols*sizeof(double);
+    }
+
+    std::ofstream file(filename, std::ios::binary);
+    file.write((const char*) &header, sizeof(header));
+    if (!entries.empty()) {
+        file.write((const char*) &entries[0], entries.size()*sizeof(binary_entry));
+    }
+
+    const char padding[BINARY_ALIGNMENT] = {0};
+    uint64_t position = sizeof(binary_header) + arrays.size()*sizeof(binary_entry);
+    for (unsigned i = 0; i < arrays.size(); i++) {
+        file.write(padding, entries[i].offset - position);
+        file.write((const char*) arrays[i].data, arrays[i].rows*arrays[i].cols*sizeof(double));
+        position = entries[i].offset + arrays[i].rows*arrays[i].cols*sizeof(double);
+    }
+
+    file.close();
+    if (!file) {
+        throw std::runtime_error("Cannot write " + filename);
+    }
+}
+
+bool rl::isBinaryArchive(const std::string& filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    char magic[sizeof(BINARY_MAGIC)];
+    file.read(magic, sizeof(magic));
+    return file && std::memcmp(magic, BINARY_MAGIC, sizeof(magic)) == 0;
+}
+
+MappedArchive::MappedArchive(const std::string& filename) : data(MAP_FAILED), length(0)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open " + filename);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        length = st.st_size;
+        data = mmap(0, length, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("Cannot map " + filename);
+    }
+
+    header = (const binary_header*) data;
+    entries = (const binary_entry*) (header + 1);
+
+    if (length < sizeof(binary_header) ||
+            std::memcmp(header->magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0 ||
+            header->version != BINARY_VERSION ||
+            header->count > (length - sizeof(binary_header))/sizeof(binary_entry)) {
+        munmap(data, length);
+        throw std::runtime_error("Not a valid binary archive " + filename);
+    }
+
+    // Divide rather than multiply, so that no size read from the file can overflow
+    for (uint64_t i = 0; i < header->count; i++) {
+        const binary_entry& entry = entries[i];
+        if (entry.offset % BINARY_ALIGNMENT != 0 || entry.offset > length ||
+                (entry.rows != 0 && entry.cols > (length - entry.offset)/entry.rows/sizeof(double))) {
+            munmap(data, length);
+            throw std::runtime_error("Truncated binary archive " + filename);
+        }
+    }
+}
+
+MappedArchive::~MappedArchive()
+{
+    munmap(data, length);
+}
+
+Eigen::Map<const Eigen::MatrixXd> MappedArchive::matrix(unsigned i) const
+{
+    if (i >= header->count) {
+        throw std::out_of_range("No such array in the binary archive");
+    }
+    const double* array = (const double*) ((const char*) data + entries[i].offset);
+    return Eigen::Map<const Eigen::MatrixXd>(array, entries[i].rows, entries[i].cols);
+}
+
+Eigen::Map<const Eigen::VectorXd> MappedArchive::vector(unsigned i) const
+{
+    if (i >= header->count) {
+        throw std::out_of_range("No such array in the binary archive");
+    }
+    const double* array = (const double*) ((const char*) data + entries[i].offset);
+    return Eigen::Map<const Eigen::VectorXd>(array, entries[i].rows*entries[i].cols);
+}
@@ -2,18 +2,69 @@
 
 #include <opencv/highgui.h>
 
+RoomsMap::RoomsMap(const std::string& filename)
+{
+    cv::Mat image = cv::imread(filename);
+    labels = cv::Mat(image.rows, image.cols, CV_8U);
+
+    for (int y = 0; y < image.rows; y++) {
+        for (int x = 0; x < image.cols; x++) {
+            cv::Vec3b intensity = image.at<cv::Vec3b>(y, x);
+            uchar blue = intensity.val[0];
+            uchar green = intensity.val[1];
+            uchar red = intensity.val[2];
+
+            uchar label = ContinuousRooms::UNKNOWN;
+            if (red == 0 && green == 255 && blue == 0) {
+                label = ContinuousRooms::GREEN;
+            } else if (red == 0 && green == 0 && blue == 255) {
+                label = ContinuousRooms::BLUE;
+            } else if (red == 255 && green == 0 && blue == 255) {
+                label = ContinuousRooms::PURPLE;
+            } else if (red == 255 && green == 255 && blue == 0) {
+                label = ContinuousRooms::YELLOW;
+            } else if (red == 0 && green == 0 && blue == 0) {
+                label = ContinuousRooms::WALL;
+            }
+            labels.at<uchar>(y, x) = label;
+        }
+    }
+}
+
 ContinuousRooms::ContinuousRooms(const std::string& filename, double robotRadius, bool randomizeInitialPosition, double safety, Random rng) : 
-    map(cv::imread(filename)),
-    robotRadius(robotRadius),
+    map(new RoomsMap(filename)),
+    space(new ConfigurationSpace(*map, robotRadius + safety)),
     randomPosition(randomizeInitialPosition),
-    safetyMargin(safety),
     rng(rng),
     minimaSteps(0)
 {
-    getCircularROI(robotRadius + safetyMargin, circularROI);
-    reset();
+    init();
+}
+
+ContinuousRooms::ContinuousRooms(std::shared_ptr<const RoomsMap> map, double robotRadius, bool randomizeInitialPosition, double safety, Random rng) : 
+    map(map),
+    space(new ConfigurationSpace(*map, robotRadius + safety)),
+    randomPosition(randomizeInitialPosition),
+    rng(rng),
+    minimaSteps(0)
+{
+    init();
+}
+
+ContinuousRooms::ContinuousRooms(std::shared_ptr<const RoomsMap> map, std::shared_ptr<const ConfigurationSpace> space, bool randomizeInitialPosition, Random rng) : 
+    map(map),
+    space(space),
+    randomPosition(randomizeInitialPosition),
+    rng(rng),
+    minimaSteps(0)
+{
+    init();
+}
+
+void ContinuousRooms::init()
+{
     currentState.resize(7);
-    updateStateVector();
+    reset();
 }
 
 const std::vector<float>& ContinuousRooms::sensation() const
@@ -24,33 +75,15 @@ const std::vector<float>& ContinuousRooms::sensation() const
 void ContinuousRooms::updateStateVector()
 {
     // Returns pose and floor color 
-    cv::Vec3b intensity = map.at<cv::Vec3b>(y, x);
-
-    // A binary variable represents the color sensed under the robot
-    uchar blue = intensity.val[0];
-    uchar green = intensity.val[1];
-    uchar red = intensity.val[2];
-
-    if (red == 0 && green == 255 && blue == 0) {
-        currentState[0] = 1;
-        currentState[1] = 0;
-        currentState[2] = 0;
-        currentState[3] = 0;
-    } else if (red == 0 && green == 0 && blue == 255) {
-        currentState[0] = 0;
-        currentState[1] = 1;
-        currentState[2] = 0;
-        currentState[3] = 0;
-    } else if (red == 255 && green == 0 && blue == 255) {
-        currentState[0] = 0;
-        currentState[1] = 0;
-        currentState[2] = 1;
-        currentState[3] = 0;
-    } else if (red == 255 && green == 255 && blue == 0) {
-        currentState[0] = 0;
-        currentState[1] = 0;
-        currentState[2] = 0;
-        currentState[3] = 1;
+    uchar label = map->label(x, y);
+
+    // A binary variable represents the color sensed under the robot.
+    // The last color sensed is kept over walls and unknown colors.
+    if (label < NUM_COLORS) {
+        for (int color = 0; color < NUM_COLORS; color++) {
+            currentState[color] = 0;
+        }
+        currentState[label] = 1;
     }
     
     currentState[4] = x;
@@ -58,35 +91,35 @@ void ContinuousRooms::updateStateVector()
     currentState[6] = psi;
 }
 
-void ContinuousRooms::getCircularROI(int R, std::vector<int>& circularROI)
+ConfigurationSpace::ConfigurationSpace(const RoomsMap& map, int R)
 {
-    circularROI.resize(R+1);
-    for( int y = 0; y <= R; y++ ) {
-        circularROI[y] = cvRound(sqrt((double)R*R - y*y));
+    // Structuring element with the shape of the robot
+    cv::Mat disc = cv::Mat::zeros(2*R + 1, 2*R + 1, CV_8U);
+    for (int dy = -R; dy <= R; dy++) {
+        int Rx = cvRound(sqrt((double)R*R - dy*dy));
+        for (int dx = -Rx; dx <= Rx; dx++) {
+            disc.at<uchar>(dy + R, dx + R) = 1;
+        }
+    }
+
+    // A configuration is in collision if a wall lies within the disc
+    // or if the disc goes beyond the boundaries of the map
+    cv::Mat walls;
+    cv::compare(map.labels, cv::Scalar(ContinuousRooms::WALL), walls, cv::CMP_EQ);
+    cv::dilate(walls, occupancy, disc, cv::Point(-1, -1), 1, cv::BORDER_CONSTANT, cv::Scalar(255));
+
+    for (int y = 0; y < occupancy.rows; y++) {
+        for (int x = 0; x < occupancy.cols; x++) {
+            if (occupancy.at<uchar>(y, x) == 0) {
+                freeCells.push_back(cv::Point(x, y));
+            }
+        }
     }
 }
 
 bool ContinuousRooms::isCollisionFree(double xPrime, double yPrime)
 {
-   for (int dy = -robotRadius - safetyMargin; dy <= robotRadius + safetyMargin; dy++) { 
-       int Rx = circularROI[abs(dy)];
-       for (int dx = -Rx; dx <= Rx; dx++ ) { 
-           // Check boundary conditions
-           if (xPrime + dx >= map.size().width || yPrime + dy >= map.size().height) {
-               std::cerr << "Boundary" << std::endl;
-               return false;
-           }
-
-           // Check if there would be a wall within the circle
-           if (map.at<cv::Vec3b>(yPrime + dy, xPrime + dx)[0] == 0 && 
-               map.at<cv::Vec3b>(yPrime + dy, xPrime + dx)[1] == 0 && 
-               map.at<cv::Vec3b>(yPrime + dy, xPrime + dx)[2] == 0) {
-               return false; 
-           } 
-       }
-   }
-
-   return true;
+    return space->isFree(xPrime, yPrime);
 }
 
 bool ContinuousRooms::detectMinima()
@@ -113,10 +146,8 @@ float ContinuousRooms::apply(int action)
 
    // Check if we have reached the goal 
    // by entering the bottom right corner yellow room 
-   if ((x > map.size().width/2.0 && y > map.size().height/2.0) 
-           &&  (map.at<cv::Vec3b>(y, x)[2] == 255 && 
-               map.at<cv::Vec3b>(y, x)[1] == 255 && 
-               map.at<cv::Vec3b>(y, x)[0] == 0)) {
+   if ((x > map->width()/2.0 && y > map->height()/2.0) 
+           && map->label(x, y) == YELLOW) {
        terminated = true;
        updateStateVector();
        std::cout << "**** The global goal for the environment was reached" << std::endl;
@@ -184,11 +215,8 @@ void ContinuousRooms::reset()
     double xInit = 12; 
     double yInit = 12; 
 
-    if (randomPosition) {
-        do {
-            xInit = rng.uniform(robotRadius/2.0, map.size().width-1);
-            yInit = rng.uniform(robotRadius/2.0, map.size().height-1);
-        } while (!isCollisionFree(xInit, yInit));
+    if (randomPosition && !space->freeCells.empty()) {
+        space->sample(rng, xInit, yInit);
     }
 
     x = xInit; 
@@ -198,6 +226,12 @@ void ContinuousRooms::reset()
 
     psi = M_PI/2.0;
     minimaSteps = 0;
+
+    // Forget the color sensed during the previous episode
+    for (int color = 0; color < NUM_COLORS; color++) {
+        currentState[color] = 0;
+    }
+    updateStateVector();
 }
 
 int ContinuousRooms::getNumActions()
@@ -0,0 +1,190 @@
+#include <linear_options/ContinuousRoomsBatch.hh>
+
+#include <limits>
+
+ContinuousRoomsBatch::ContinuousRoomsBatch(std::shared_ptr<const RoomsMap> map, unsigned size, double robotRadius, bool randomizeInitialPosition, double safetyMargin, Random rng) :
+    ContinuousRoomsBatch(map, std::shared_ptr<const ConfigurationSpace>(new ConfigurationSpace(*map, robotRadius + safetyMargin)), size, randomizeInitialPosition, rng)
+{
+}
+
+ContinuousRoomsBatch::ContinuousRoomsBatch(std::shared_ptr<const RoomsMap> map, std::shared_ptr<const ConfigurationSpace> space, unsigned size, bool randomizeInitialPosition, Random rng) :
+    ContinuousRoomsBatch(map, space, split(rng, size), randomizeInitialPosition)
+{
+}
+
+ContinuousRoomsBatch::ContinuousRoomsBatch(std::shared_ptr<const RoomsMap> map, std::shared_ptr<const ConfigurationSpace> space, const std::vector<Random>& streams, bool randomizeInitialPosition) :
+    x(streams.size()),
+    y(streams.size()),
+    psi(streams.size()),
+    lastX(streams.size()),
+    lastY(streams.size()),
+    minimaSteps(streams.size()),
+    terminated(streams.size()),
+    colors(streams.size()),
+    map(map),
+    space(space),
+    randomPosition(randomizeInitialPosition),
+    streams(streams),
+    labels(streams.size()),
+    goal(streams.size()),
+    forward(streams.size()),
+    blocked(streams.size()),
+    xPrime(streams.size()),
+    yPrime(streams.size()),
+    noiseX(Eigen::ArrayXd::Zero(streams.size())),
+    noiseY(Eigen::ArrayXd::Zero(streams.size())),
+    resets(streams.size())
+{
+    reset();
+}
+
+std::vector<Random> ContinuousRoomsBatch::split(Random rng, unsigned size)
+{
+    std::vector<Random> streams;
+    streams.reserve(size);
+    for (unsigned i = 0; i < size; i++) {
+        streams.push_back(Random(rng.uniformDiscrete(1, std::numeric_limits<int>::max())));
+    }
+    return streams;
+}
+
+void ContinuousRoomsBatch::reset()
+{
+    for (unsigned i = 0; i < size(); i++) {
+        terminated[i] = 0;
+        reset(i);
+    }
+}
+
+void ContinuousRoomsBatch::reset(unsigned i)
+{
+    double xInit = 12;
+    double yInit = 12;
+
+    if (randomPosition && !space->freeCells.empty()) {
+        space->sample(streams[i], xInit, yInit);
+    }
+
+    x(i) = xInit;
+    lastX(i) = xInit;
+    y(i) = yInit;
+    lastY(i) = yInit;
+
+    psi(i) = M_PI/2.0;
+    minimaSteps[i] = 0;
+
+    labels[i] = map->label(x(i), y(i));
+    colors[i] = labels[i] < ContinuousRooms::NUM_COLORS ? labels[i] : ContinuousRooms::NUM_COLORS;
+}
+
+void ContinuousRoomsBatch::sense()
+{
+    for (unsigned i = 0; i < size(); i++) {
+        labels[i] = map->labels.ptr(int(y(i)))[int(x(i))];
+        colors[i] = labels[i] < ContinuousRooms::NUM_COLORS ? labels[i] : colors[i];
+    }
+}
+
+void ContinuousRoomsBatch::apply(const std::vector<int>& actions, std::vector<float>& rewards)
+{
+    const unsigned n = size();
+    rewards.resize(n);
+
+    // The goal is reached by standing in the bottom right corner yellow room,
+    // as sensed at the end of the previous step. Robots at the goal stay put.
+    const double halfWidth = map->width()/2.0;
+    const double halfHeight = map->height()/2.0;
+    for (unsigned i = 0; i < n; i++) {
+        goal[i] = (x(i) > halfWidth) & (y(i) > halfHeight) & (labels[i] == ContinuousRooms::YELLOW);
+        forward[i] = !goal[i] & (actions[i] == ContinuousRooms::FORWARD);
+    }
+
+    // Masked motion model. FORWARD moves 1 unit in the current orientation
+    // with zero mean Gaussian noise with 0.1 std deviation, drawn from the 
+    // stream of the robot only when it moves, as ContinuousRooms does. 
+    // LEFT and RIGHT turn the robot 30 degrees in the specified direction.
+    for (unsigned i = 0; i < n; i++) {
+        if (forward[i]) {
+            noiseX(i) = streams[i].normal(0.0, 0.1);
+            noiseY(i) = streams[i].normal(0.0, 0.1);
+        }
+    }
+
+    lastX = x;
+    lastY = y;
+    xPrime = x + psi.cos() + noiseX;
+    yPrime = y + psi.sin() + noiseY;
+
+    const double turn = M_PI/6.0;
+    for (unsigned i = 0; i < n; i++) {
+        const bool right = !goal[i] & (actions[i] == ContinuousRooms::RIGHT);
+        const bool left = !goal[i] & (actions[i] == ContinuousRooms::LEFT);
+        psi(i) += right ? turn : left ? -turn : 0.0;
+        psi(i) = ((right & (psi(i) == 2.0*M_PI)) | (left & (psi(i) == -2.0*M_PI))) ? 0.0 : psi(i);
+    }
+
+    // Gathered lookup of the configuration space at the candidate positions.
+    // Positions beyond the boundaries of the map read the first cell and are
+    // masked out.
+    const cv::Mat& occupancy = space->occupancy;
+    for (unsigned i = 0; i < n; i++) {
+        const int col = std::floor(xPrime(i));
+        const int row = std::floor(yPrime(i));
+        const bool inside = (col >= 0) & (row >= 0) & (col < occupancy.cols) & (row < occupancy.rows);
+        const bool free = inside & (occupancy.ptr(inside ? row : 0)[inside ? col : 0] == 0);
+        blocked[i] = forward[i] & !free;
+        x(i) = (forward[i] & free) ? xPrime(i) : x(i);
+        y(i) = (forward[i] & free) ? yPrime(i) : y(i);
+    }
+
+    // Gathered lookup of the labels at the new positions
+    sense();
+
+    // Minima detection, as in ContinuousRooms::detectMinima, and rewards
+    unsigned numberResets = 0;
+    for (unsigned i = 0; i < n; i++) {
+        const bool minima = !goal[i] & (minimaSteps[i] > ContinuousRooms::MAX_NUMBER_STEPS);
+        const bool still = std::sqrt(std::pow(x(i) - lastX(i), 2) + std::pow(y(i) - lastY(i), 2)) < ContinuousRooms::MIN_DISPLACEMENT;
+        minimaSteps[i] = still ? minimaSteps[i] + 1 : 0;
+        terminated[i] = goal[i] | minima;
+
+        rewards[i] = goal[i] ? ContinuousRooms::REWARD_SUCCESS
+            : minima ? ContinuousRooms::NEGATIVE_REWARD_MINIMA
+            : blocked[i] ? ContinuousRooms::NEGATIVE_REWARD_COLLISION
+            : ContinuousRooms::NEGATIVE_REWARD_EXTRA_STEP;
+
+        // Compact the indices of the terminated robots
+        resets[numberResets] = i;
+        numberResets += terminated[i];
+    }
+
+    for (unsigned k = 0; k < numberResets; k++) {
+        reset(resets[k]);
+    }
+}
+
+void ContinuousRoomsBatch::sensation(unsigned i, std::vector<float>& s) const
+{
+    s.assign(7, 0);
+    if (colors[i] < ContinuousRooms::NUM_COLORS) {
+        s[colors[i]] = 1;
+    }
+
+    s[4] = x(i);
+    s[5] = y(i);
+    s[6] = psi(i);
+}
+
+void ContinuousRoomsBatch::sensations(Eigen::MatrixXd& S) const
+{
+    S.setZero(7, size());
+    for (unsigned i = 0; i < size(); i++) {
+        if (colors[i] < ContinuousRooms::NUM_COLORS) {
+            S(colors[i], i) = 1;
+        }
+    }
+
+    S.row(4) = x.matrix().transpose();
+    S.row(5) = y.matrix().transpose();
+    S.row(6) = psi.matrix().transpose();
+}
@@ -0,0 +1,93 @@
+#include <linear_options/BinaryArchive.hh>
+#include <linear_options/serialization.hh>
+#include <linear_options/Option.hh>
+
+#include <boost/serialization/vector.hpp>
+
+#include <fstream>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+/**
+ * Convert the text archives written by LinearQ0Learner::savePolicy,
+ * LOEMAgent::saveOptions and DynaLOEMAgent::saveOptionModels
+ * into the binary format. The option models can be factorized on the way.
+ *
+ * Usage: 
+ *   convert_archive policy <policy.rl> <output>
+ *   convert_archive options <options.rl> <output>
+ *   convert_archive models <options.rl> <models.rl> <output> [rank]
+ */
+int main(int argc, char** argv)
+{
+    std::string kind = (argc > 1) ? argv[1] : "";
+
+    if (kind == "policy" && argc == 4) {
+        std::ifstream ifs(argv[2], std::ios::binary);
+        boost::archive::text_iarchive ia(ifs);
+        std::vector<Eigen::VectorXd> thetas;
+        ia >> thetas;
+
+        Eigen::MatrixXd policy = rl::fromColumns(thetas);
+        std::vector<rl::binary_array> arrays;
+        arrays.push_back(rl::binary_array(policy));
+        rl::saveBinary(argv[3], rl::BINARY_POLICY, arrays);
+        return 0;
+    }
+
+    if ((kind == "options" && argc == 4) || (kind == "models" && (argc == 5 || argc == 6))) {
+        std::ifstream ifs(argv[2], std::ios::binary);
+        boost::archive::text_iarchive ia(ifs);
+        std::vector<rl::LinearOption*> options;
+        ia >> options;
+
+        std::vector<rl::binary_array> arrays;
+
+        if (kind == "options") {
+            for (unsigned i = 0; i < options.size(); i++) {
+                arrays.push_back(rl::binary_array(options[i]->getActionValueThetas()));
+                arrays.push_back(rl::binary_array(options[i]->theta));
+            }
+            rl::saveBinary(argv[3], rl::BINARY_OPTIONS, arrays);
+            return 0;
+        }
+
+        // There is one model per option in the models archive
+        unsigned rank = (argc == 6) ? std::atoi(argv[5]) : 0;
+        std::ifstream ifsModels(argv[3], std::ios::binary);
+        boost::archive::text_iarchive iaModels(ifsModels);
+        std::vector<rl::LinearOptionModel*> models(options.size());
+        for (unsigned i = 0; i < options.size(); i++) {
+            iaModels >> models[i];
+            if (rank && !models[i]->factored()) {
+                models[i]->factorize(rank);
+            }
+
+            if (models[i]->factored()) {
+                arrays.push_back(rl::binary_array(models[i]->U));
+                arrays.push_back(rl::binary_array(models[i]->V));
+            } else {
+                arrays.push_back(rl::binary_array(models[i]->F));
+            }
+            arrays.push_back(rl::binary_array(models[i]->b));
+        }
+
+        // The kind of the archive must hold for every model
+        bool factored = !models.empty() && models[0]->factored();
+        for (unsigned i = 0; i < models.size(); i++) {
+            if (models[i]->factored() != factored) {
+                std::cerr << "Mixed dense and factored option models in " << argv[3] << ", give a rank to factorize them all" << std::endl;
+                return 1;
+            }
+        }
+        rl::saveBinary(argv[4], factored ? rl::BINARY_FACTORED_OPTION_MODELS : rl::BINARY_OPTION_MODELS, arrays);
+        return 0;
+    }
+
+    std::cerr << "Usage: " << std::endl;
+    std::cerr << "  convert_archive policy <policy.rl> <output>" << std::endl;
+    std::cerr << "  convert_archive options <options.rl> <output>" << std::endl;
+    std::cerr << "  convert_archive models <options.rl> <models.rl> <output> [rank]" << std::endl;
+    return 1;
+}
@@ -1,71 +1,366 @@
 #include <linear_options/DynaLOEMAgent.hh>
+
+#include <cmath>
+#include <limits>
 #include <algorithm>
 
 using namespace rl;
 
-DynaLOEMAgent::DynaLOEMAgent(unsigned numActions, double alpha, double epsilon, double gamma, rl::state_abstraction& stateAbstraction, const std::string& optionsFile, const std::string& optionModelsFile, Random rng) : LOEMAgent(numActions, alpha, epsilon, gamma, stateAbstraction, rng), optionsFile(optionsFile), optionModelsFile(optionModelsFile)
+DynaLOEMAgent::DynaLOEMAgent(unsigned numActions, double alpha, double epsilon, double gamma, rl::state_abstraction& stateAbstraction, const std::string& optionsFile, const std::string& optionModelsFile, Random rng, unsigned modelRank) : LOEMAgent(numActions, alpha, epsilon, gamma, stateAbstraction, rng), optionsFile(optionsFile), optionModelsFile(optionModelsFile), modelRank(modelRank), planningBudget(0), prioritized(false), pendingUpdates(0), planning(false)
 {
     loadOptions(optionsFile);
+    for (unsigned i = 0; i < options.size(); i++) {
+        registry.add(options[i]);
+    }
     loadOptionModels(optionModelsFile);
 }
 
-LinearOption* DynaLOEMAgent::getBestOption(const Eigen::VectorXd& phi)
+DynaLOEMAgent::~DynaLOEMAgent()
+{
+    stopPlanning();
+}
+
+void DynaLOEMAgent::setPlanning(unsigned budget, unsigned threads, unsigned capacity)
+{
+    stopPlanning();
+
+    planningBudget = budget;
+    prioritized = false;
+    visitedStates.reset(capacity);
+    visitedSparseStates.reset(capacity);
+    visitedBinaryStates.reset(capacity);
+    startPlanning(threads);
+}
+
+void DynaLOEMAgent::setPrioritizedPlanning(unsigned budget, double threshold, unsigned threads)
+{
+    stopPlanning();
+
+    planningBudget = budget;
+    prioritized = true;
+    visitedStates.reset(0);
+    visitedSparseStates.reset(0);
+    visitedBinaryStates.reset(0);
+    sweeps.reset(registry.getThetas().rows(), threshold);
+    startPlanning(threads);
+}
+
+void DynaLOEMAgent::setLeastSquaresModels(double regularization, bool record)
 {
-    ValueComparator comp(phi);
+    auto guards = lockOptions();
 
-    LinearOption* nextOption = (rng.uniform() < epsilon) ? 
-        options.at(rng.uniformDiscrete(0, options.size()-1)) : 
-        // FIXME This assumes every option is available everywhere
-        *std::max_element(options.begin(), options.end(), comp); 
+    modelLearners.clear();
+    for (option_id o = 0; o < registry.size(); o++) {
+        if (registry.model(o).factored()) {
+            throw std::runtime_error("Least-squares model learning needs dense option models");
+        }
+        modelLearners.push_back(LSTDOptionModelLearner(registry.model(o), gamma, regularization, record));
+    }
+}
 
-    return nextOption;
+void DynaLOEMAgent::solveOptionModels()
+{
+    auto guards = lockOptions();
+
+    for (option_id o = 0; o < modelLearners.size(); o++) {
+        modelLearners[o].solve(registry.model(o));
+    }
+}
+
+void DynaLOEMAgent::startPlanning(unsigned threads)
+{
+    if (planningBudget == 0 || threads == 0) {
+        return;
+    }
+
+    optionLocks.reset(new std::mutex[registry.size()]);
+    planning = true;
+    for (unsigned i = 0; i < threads; i++) {
+        planners.push_back(std::thread(&DynaLOEMAgent::planningLoop, this, rng.uniformDiscrete(1, std::numeric_limits<int>::max())));
+    }
+}
+
+void DynaLOEMAgent::stopPlanning()
+{
+    {
+        std::lock_guard<std::mutex> lock(planningMutex);
+        planning = false;
+        pendingUpdates = 0;
+    }
+    planningAvailable.notify_all();
+
+    for (auto it = planners.begin(); it != planners.end(); it++) {
+        it->join();
+    }
+    planners.clear();
+    optionLocks.reset();
+}
+
+template<class Features>
+option_id DynaLOEMAgent::getBestOption(const Features& phi)
+{
+    if (rng.uniform() < epsilon) {
+        return rng.uniformDiscrete(0, registry.size()-1);
+    }
+
+    // FIXME This assumes every option is available everywhere
+    option_id best = 0;
+    registry.values(phi, workspace.values);
+    workspace.values.maxCoeff(&best);
+    return best;
 }
 
 int DynaLOEMAgent::first_action(const std::vector<float> &s)
 {
-    auto phi = project(s);
-    lastPhi = phi;
+    auto guards = lockOptions();
+    stateAbstraction->reset();
 
-    currentOption = getBestOption(phi);
+    if (binaryAbstraction) {
+        project(s, lastBinaryPhi);
+        currentOption = getBestOption(lastBinaryPhi);
+        lastAction = registry.option(currentOption).greedyPolicy(lastBinaryPhi);
+        return lastAction;
+    }
+
+    if (sparseAbstraction) {
+        project(s, lastSparsePhi);
+        currentOption = getBestOption(lastSparsePhi);
+        lastAction = registry.option(currentOption).greedyPolicy(lastSparsePhi);
+        return lastAction;
+    }
 
-    return currentOption->greedyPolicy(phi);
+    project(s, lastPhi);
+    currentOption = getBestOption(lastPhi);
+    lastAction = registry.option(currentOption).greedyPolicy(lastPhi);
+
+    return lastAction;
 }
 
-int DynaLOEMAgent::next_action(float r, const std::vector<float> &s)
+template<class Features>
+int DynaLOEMAgent::step(float r, const Features& phi, const Features& lastPhi)
 {
-    auto phi = project(s); 
+    const unsigned numOptions = registry.size();
+    workspace.resize(numOptions);
+
+    // Keep the planning threads away for the duration of the step
+    auto guards = lockOptions();
+
+    // Gather every per-option quantity of this step once.
+    // The values of all the options are a single product.
+    registry.values(phi, workspace.values);
+    for (option_id o = 0; o < numOptions; o++) {
+        LinearOption& option = registry.option(o);
+        workspace.modelValues(o) = registry.model(o).value(registry.theta(o), phi, workspace.model);
+        workspace.betas[o] = option.beta(phi);
+        workspace.greedyActions[o] = option.greedyPolicy(phi);
+    }
+
+    // Value of the best option in the current state
+    double maxValue = workspace.values.maxCoeff();
 
     // Find the option with highest expected discounted reward from the current state
-    NextStateValueComparator comp(this, phi);
-    LinearOption* maxOption = *std::max_element(options.begin(), options.end(), comp);
-    double maxOptionValue = maxOption->theta.dot(optionModels[maxOption]->F*phi);
+    double maxOptionValue = workspace.modelValues.maxCoeff();
+
+    // Largest planning change at the current state
+    double maxChange = 0;
+
+    for (option_id o = 0; o < numOptions; o++) {
+        LinearOptionModel& model = registry.model(o);
+        double beta = workspace.betas[o];
+        double value = workspace.values(o);
 
-    for (auto it = options.begin(); it != options.end(); it++) {
         // Update every consistent option for which u(phi) = a
-        if ((*it)->greedyPolicy(phi) == lastAction) {
+        if (workspace.greedyActions[o] == lastAction) {
             
             // Intra-Option value learning 
-            Eigen::VectorXd& thetaOption = (*it)->theta;
-            double U = (1 - (*it)->beta(phi))*thetaOption.dot(phi) + (*it)->beta(phi)*getBestOption(phi)->theta.dot(phi);
-            thetaOption = thetaOption + alpha*(r + gamma*U - thetaOption.transpose()*phi)*phi;
+            double U = (1 - beta)*value + beta*maxValue;
+            axpy(alpha*(r + gamma*U - value), phi, registry.theta(o));
+            value = dot(registry.theta(o), phi);
 
-            // Intra-Option model learning for transition kernel F 
-            Eigen::VectorXd eta = lastPhi - gamma*(1 - (*it)->beta(phi))*phi;
-            optionModels[(*it)]->F = optionModels[(*it)]->F + alpha*(gamma*(*it)->beta(phi)*phi - optionModels[(*it)]->F*eta)*eta.transpose();
+            // Intra-Option model learning for transition kernel F, dense or factored
+            if (modelLearners.empty()) {
+                auto& eta = workspace.eta.combination(phi);
+                assign(eta, lastPhi);
+                axpy(-gamma*(1 - beta), phi, eta);
+                model.update(alpha, gamma*beta, phi, eta, workspace.model);
+            } else {
+                modelLearners[o].update(model, lastPhi, r, phi, beta);
+            }
         }
 
         // Execute one planning update for every option
-        (*it)->theta = (*it)->theta.array() + alpha*optionModels[*it]->b.dot(phi) + maxOptionValue - (*it)->theta.dot(phi); 
+        double change = alpha*(dot(model.b, phi) + maxOptionValue - value);
+        axpy(change, phi, registry.theta(o)); 
+        maxChange = std::max(maxChange, std::fabs(change));
+    }
+
+    if (prioritized) {
+        sweeps.raise(maxChange, phi);
     }
 
     // Pick a new option if the current one must terminate
-    if (currentOption->terminate(phi)) {
+    if (rng.uniform() < workspace.betas[currentOption]) {
         currentOption = getBestOption(phi);
     }
 
-    lastPhi = phi;
+    // The policies of the options are fixed, so the greedy actions still hold
+    lastAction = workspace.greedyActions[currentOption];
+    return lastAction;
+}
+
+template<class Features>
+void DynaLOEMAgent::plan(const Features& phi, planning_workspace& workspace)
+{
+    double maxOptionValue = -std::numeric_limits<double>::max();
+    for (option_id o = 0; o < registry.size(); o++) {
+        auto guard = lockOption(o);
+        maxOptionValue = std::max(maxOptionValue, registry.model(o).value(registry.theta(o), phi, workspace.model));
+    }
+
+    for (option_id o = 0; o < registry.size(); o++) {
+        auto guard = lockOption(o);
+        double value = dot(registry.theta(o), phi);
+        axpy(alpha*(dot(registry.model(o).b, phi) + maxOptionValue - value), phi, registry.theta(o));
+    }
+}
+
+template<class Features>
+void DynaLOEMAgent::schedulePlanning(PlanningBuffer<Features>& states, const Features& phi)
+{
+    if (planningBudget == 0) {
+        return;
+    }
+
+    // Prioritized sweeping plans from the queue filled by step instead
+    if (!prioritized) {
+        states.push(phi);
+    }
+
+    if (planners.empty()) {
+        for (unsigned k = 0; k < planningBudget; k++) {
+            if (!planOnce(rng, planningWorkspace)) {
+                break;
+            }
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(planningMutex);
+        pendingUpdates += planningBudget;
+    }
+    planningAvailable.notify_all();
+}
+
+bool DynaLOEMAgent::planOnce(Random& rng, planning_workspace& workspace)
+{
+    if (prioritized) {
+        unsigned j;
+        if (!sweeps.pop(j)) {
+            return false;
+        }
+        sweep(j, workspace);
+        return true;
+    }
+
+    if (binaryAbstraction) {
+        binary_features& state = workspace.state.binary;
+        if (!visitedBinaryStates.sample(rng, state)) {
+            return false;
+        }
+        plan(state, workspace);
+        return true;
+    }
+
+    if (sparseAbstraction) {
+        sparse_features& state = workspace.state.sparse;
+        if (!visitedSparseStates.sample(rng, state)) {
+            return false;
+        }
+        plan(state, workspace);
+        return true;
+    }
+
+    Eigen::VectorXd& state = workspace.state.dense;
+    if (!visitedStates.sample(rng, state)) {
+        return false;
+    }
+    plan(state, workspace);
+    return true;
+}
+
+void DynaLOEMAgent::sweep(unsigned j, planning_workspace& workspace)
+{
+    sparse_features& phi = workspace.unit;
+    phi.clear();
+    phi.dimension = registry.getThetas().rows();
+    phi.push_back(j, 1);
+
+    double maxOptionValue = -std::numeric_limits<double>::max();
+    for (option_id o = 0; o < registry.size(); o++) {
+        auto guard = lockOption(o);
+        maxOptionValue = std::max(maxOptionValue, registry.model(o).value(registry.theta(o), phi, workspace.model));
+    }
+
+    for (option_id o = 0; o < registry.size(); o++) {
+        auto guard = lockOption(o);
+        LinearOptionModel& model = registry.model(o);
+        double change = alpha*(model.b(j) + maxOptionValue - registry.theta(o)(j));
+        registry.theta(o)(j) += change;
+
+        // The planning targets of the features leading to j have moved
+        model.row(j, workspace.row);
+        sweeps.raise(std::fabs(change), workspace.row);
+    }
+}
+
+void DynaLOEMAgent::planningLoop(unsigned seed)
+{
+    Random rng(seed);
+    planning_workspace workspace;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(planningMutex);
+            while (pendingUpdates == 0 && planning) {
+                planningAvailable.wait(lock);
+            }
+            if (!planning) {
+                return;
+            }
+            pendingUpdates--;
+        }
+
+        planOnce(rng, workspace);
+    }
+}
+
+int DynaLOEMAgent::next_action(float r, const std::vector<float> &s)
+{
+    if (binaryAbstraction) {
+        // Only the weights of the active features are gathered and updated
+        project(s, binaryPhi);
+        int action = step(r, binaryPhi, lastBinaryPhi);
+        std::swap(lastBinaryPhi, binaryPhi);
+        schedulePlanning(visitedBinaryStates, lastBinaryPhi);
+        return action;
+    }
+
+    if (sparseAbstraction) {
+        // Only the active features are read and updated
+        project(s, sparsePhi);
+        int action = step(r, sparsePhi, lastSparsePhi);
+        std::swap(lastSparsePhi, sparsePhi);
+        schedulePlanning(visitedSparseStates, lastSparsePhi);
+        return action;
+    }
+
+    project(s, phi); 
+    int action = step(r, phi, lastPhi);
+    lastPhi.swap(phi);
+    schedulePlanning(visitedStates, lastPhi);
 
-    return currentOption->greedyPolicy(phi);
+    return action;
 }
 
 void DynaLOEMAgent::last_action(float r)
@@ -1,7 +1,11 @@
-#include <linear_options/StateAbstraction.hh>
+#include <linear_options/RoomAbstraction.hh>
+#include <linear_options/CompactAbstraction.hh>
 #include <linear_options/ContinuousRooms.hh>
 #include <linear_options/LinearQ0Learner.hh>
 #include <linear_options/RewardDecorator.hh>
+#include <linear_options/TrajectoryRenderer.hh>
+#include <linear_options/ExperienceQueue.hh>
+#include <linear_options/StaticAgents.hh>
 
 #include <opencv/cv.h>
 #include <opencv/highgui.h>
@@ -9,50 +13,14 @@
 #include <sstream>
 #include <fstream>
 #include <string>
-
-/**
- * We build the feature vector from a set of radial basis functions
- * spread over the space in the x, y and psi dimensions. 
- */
-struct room_abstraction : public rl::state_abstraction
-{
-    /**
-     * @param U The mean of the RBF
-     * @param C
-     * @param b
-     */
-    room_abstraction(Eigen::MatrixXd U, Eigen::Vector3d C, double b) :
-       b(b), U(U), C(C.asDiagonal()) {};
-
-    /**
-     * @param s Project the input vector in the n-d space
-     */
-    Eigen::VectorXd operator()(const Eigen::VectorXd& s) {
-        Eigen::VectorXd phi(length());
-        // The first 4 elements are binary indicator variables for floor color
-        phi(0) = s[0];
-        phi(1) = s[1];
-        phi(2) = s[2];
-        phi(3) = s[3];
-
-        // The next 3 elements: x, y, psi
-        for (int i = 0; i < U.rows(); i++) {
-            phi(i + 4) = b*exp(-0.5*(s.tail(U.cols()) - U.row(i).transpose()).dot(C*(s.tail(U.cols()) - U.row(i).transpose()))); 
-            if (phi(i + 4) < 0.1) { 
-                phi(i + 4) = 0;
-            }
-        }
-
-        return phi;
-    }
-
-    int length() { return U.rows() + 4; }
-
-private:
-    double b;
-    Eigen::MatrixXd U;
-    Eigen::DiagonalMatrix<double, 3, 3> C;
-};
+#include <cstdlib>
+#include <algorithm>
+#include <thread>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <deque>
 
 /**
  * Subclasses the LinearOptions to specify the termination set
@@ -73,6 +41,29 @@ struct ReachNearestStateOfColor : public rl::LinearOption
         }
         return 0;
     }
+
+    /**
+     * @Override
+     */
+    double beta(const rl::sparse_features& phi)
+    {
+        // The color indicators are the first entries of the projection
+        if (phi.coeff(targetColor)) {
+            return 1;
+        }
+        return 0;
+    }
+
+    /**
+     * @Override
+     */
+    double beta(const rl::binary_features& phi)
+    {
+        if (phi.coeff(targetColor)) {
+            return 1;
+        }
+        return 0;
+    }
 };
 
 /**
@@ -107,43 +98,26 @@ struct ReachNearestColorRewardDecorator : public rl::RewardDecorator
     }
 };
 
-int main(void)
+/**
+ * Run the learning episodes for one option and save the resulting policy
+ * @param agent The learner wrapped in the pseudo-reward function of the option
+ * @param env The environment in which the agent learns
+ * @param agentIdx Index of the agent, used to name the output files
+ * @param numberLearningEpisodes Number of episodes to run
+ * @param display Show the trajectory of the robot during learning
+ * @param renderer If not null, receives the trajectories of the sampled episodes
+ */
+void learnOption(rl::RewardDecorator& agent, ContinuousRooms& env, unsigned agentIdx, unsigned numberLearningEpisodes, bool display, TrajectoryRenderer* renderer)
 {
-// Radial-basis functions are placed every 10 units in 
-// in the x and y dimensions and every 30 degrees
-Eigen::MatrixXd U(5200, 3);
-int i = 0;
-for (double x = 10.2/2.0; x < 200; x += 10) {
-    for (double y = 10.2/2.0; y < 200; y += 10) {
-        for (double psi = 0; psi <= 360; psi += 30) {
-            U(i, 0) = x;
-            U(i, 1) = y;
-            U(i, 2) = psi;
-            i += 1;
-        }
-    }
-}
-Eigen::Vector3d C(1.0/10.2, 1.0/10.2, 1/30);
-room_abstraction stateAbstraction(U, C, 20);
-
-// Instantiate agents for learning a policy for reaching 
-// the subgoals defined by the pseudo-reward functions
-std::vector<rl::RewardDecorator*> agents;
-for (int color = 0; color < ContinuousRooms::NUM_COLORS; color++) {
-    agents.push_back(new ReachNearestColorRewardDecorator(*(new rl::LinearQ0Learner(ContinuousRooms::NUM_ACTIONS, 5e-4, 0.1, 0.9, stateAbstraction)), color));
-}
-
-// We use a virtual world of 200x200 units with a 10 units wide robot
-const double robotRadius = 5;
-ContinuousRooms env("map.png", robotRadius, true);
+    std::vector<cv::Point> trajectory;
 
-cv::Mat img = cv::imread("map.png");
-cv::Mat imgBot = img.clone();
+    cv::Mat img;
+    cv::Mat imgBot;
+    if (display) {
+        img = cv::imread("map.png");
+        imgBot = img.clone();
+    }
 
-// Train a separate agent for each option and take the resulting policy
-const unsigned numberLearningEpisodes = 1e5; 
-unsigned agentIdx = 0;
-for (auto itAgent = agents.begin(); itAgent != agents.end(); itAgent++) {
     // Keep track of the cumulative number of completed episodes
     // and also the number of steps per epsiodes
     std::stringstream ss;
@@ -159,19 +133,25 @@ for (auto itAgent = agents.begin(); itAgent != agents.end(); itAgent++) {
 
         unsigned numberSteps = 2;
         double totalReward = 0;
+        bool record = renderer && renderer->sampled(i);
 
         // Sense initial position and execute first action
         auto s = env.sensation();
-        auto reward = env.apply((*itAgent)->first_action(s));
+        auto reward = env.apply(agent.first_action(s));
         totalReward += reward;
 
         // Main sense-act loop
-        while (!(*itAgent)->terminal(s) && env.terminal() == false) {
+        while (!agent.terminal(s) && env.terminal() == false) {
             s = env.sensation();
-            reward = env.apply((*itAgent)->next_action(reward, s));
+            reward = env.apply(agent.next_action(reward, s));
 
-            cv::circle(imgBot, cv::Point(s[4], s[5]), 5, cv::Scalar(0, 0, 0), 1); 
-            cv::imshow("world", imgBot); 
+            if (display) {
+                cv::circle(imgBot, cv::Point(s[4], s[5]), 5, cv::Scalar(0, 0, 0), 1); 
+                cv::imshow("world", imgBot); 
+            }
+            if (record) {
+                trajectory.push_back(cv::Point(s[4], s[5]));
+            }
 
 //if(cv::waitKey(10) >= 0) break;
 //            sleep(0.125);
@@ -181,20 +161,760 @@ for (auto itAgent = agents.begin(); itAgent != agents.end(); itAgent++) {
    
         // Integrate the last reward returned in a terminal state 
         s = env.sensation();
-        (*itAgent)->last_action(reward);
+        agent.last_action(reward);
         totalReward += reward;
 
         env.reset();
-        imgBot = img.clone();
+        if (display) {
+            imgBot = img.clone();
+        }
+        if (record) {
+            renderer->push(i, trajectory);
+        }
 
         // Record statistics
         statsFile << (reward > 0) << " " << numberSteps << " " << totalReward << std::endl; 
     }
 
     // Save policy to file
-    ((rl::LinearQ0Learner*)(*itAgent)->getAgent())->savePolicy(filenamePrefix + "_options.rl");
+    ((rl::LinearQ0Learner*) agent.getAgent())->savePolicy(filenamePrefix + "_options.rl");
+}
+
+/**
+ * The pseudo-reward function of ReachNearestColorRewardDecorator,
+ * for rl::StaticRewardDecorator
+ */
+struct ReachNearestColorShaping
+{
+    ReachNearestColorShaping(int targetColor) : targetColor(targetColor) {};
+    int targetColor;
+
+    double pseudoReward(double reward, const Eigen::VectorXd& s) const
+    {
+        return s[targetColor] ? ContinuousRooms::REWARD_SUCCESS : reward;
+    }
+
+    bool terminal(const Eigen::VectorXd& s) const
+    {
+        return s[targetColor] != 0;
+    }
+};
+
+/**
+ * @param s Set to the current state of the environment, reusing its storage
+ */
+void sense(const ContinuousRooms& env, Eigen::VectorXd& s)
+{
+    const std::vector<float>& sensation = env.sensation();
+    s.resize(sensation.size());
+    for (unsigned i = 0; i < sensation.size(); i++) {
+        s(i) = sensation[i];
+    }
+}
+
+/**
+ * Run the learning episodes for one option with an agent specialized at
+ * compile time, called through its static type, and save the resulting policy
+ * @param agent The learner wrapped in the pseudo-reward function of the option
+ * @param env The environment in which the agent learns
+ * @param agentIdx Index of the agent, used to name the output files
+ * @param numberLearningEpisodes Number of episodes to run
+ */
+template<class Decorator>
+void learnOptionStatic(Decorator& agent, ContinuousRooms& env, unsigned agentIdx, unsigned numberLearningEpisodes)
+{
+    std::stringstream ss;
+    ss << "agent" << agentIdx; 
+    std::string filenamePrefix = ss.str();
+
+    std::ofstream statsFile(filenamePrefix + "_training.dat");
+
+    Eigen::VectorXd s;
+    for (unsigned i = 0; i < numberLearningEpisodes; i++) {
+        unsigned numberSteps = 2;
+        double totalReward = 0;
+
+        sense(env, s);
+        float reward = env.apply(agent.first_action(s));
+        totalReward += reward;
+
+        while (!agent.terminal(s) && env.terminal() == false) {
+            sense(env, s);
+            reward = env.apply(agent.next_action(double(reward), s));
+            numberSteps += 1;
+            totalReward += reward;
+        }
+
+        agent.last(reward);
+        totalReward += reward;
+        env.reset();
+
+        statsFile << (reward > 0) << " " << numberSteps << " " << totalReward << std::endl; 
+    }
+
+    agent.getAgent()->savePolicy(filenamePrefix + "_options.rl");
+}
+
+/**
+ * Learn every option from a single stream of experience. The behavior policy
+ * is epsilon-greedy with respect to a different option at every episode.
+ * Each transition updates all the options which have not terminated yet,
+ * off-policy, with their own pseudo-reward and termination condition.
+ * @param agents The learners wrapped in the pseudo-reward function of their option
+ * @param env The environment generating the experience
+ * @param abstraction The state abstraction shared by every learner
+ * @param numberLearningEpisodes Number of episodes of the behavior policy
+ * @param epsilon Probability of a random action for the behavior policy
+ * @param rng Random number stream of the behavior policy
+ * @param renderer If not null, receives the trajectories of the sampled episodes
+ */
+void learnOptionsFromSharedExperience(std::vector<rl::RewardDecorator*>& agents, ContinuousRooms& env, rl::sparse_state_abstraction& abstraction, unsigned numberLearningEpisodes, double epsilon, Random rng, TrajectoryRenderer* renderer)
+{
+    std::vector<cv::Point> trajectory;
+
+    std::vector<rl::LinearQ0Learner*> learners;
+    std::vector<std::unique_ptr<std::ofstream> > statsFiles;
+    for (unsigned agentIdx = 0; agentIdx < agents.size(); agentIdx++) {
+        learners.push_back((rl::LinearQ0Learner*) agents[agentIdx]->getAgent());
+
+        std::stringstream ss;
+        ss << "agent" << agentIdx << "_training.dat"; 
+        statsFiles.push_back(std::unique_ptr<std::ofstream>(new std::ofstream(ss.str())));
+    }
+
+    // The features are computed once per step and used by every learner
+    rl::sparse_features phi;
+    rl::sparse_features phiPrime;
+
+    for (unsigned i = 0; i < numberLearningEpisodes; i++) {
+        unsigned behavior = i % agents.size();
+        bool record = renderer && renderer->sampled(i);
+
+        std::cout << "---------------------------------------------" << std::endl;
+        std::cout << "Behavior " << behavior << " Episode " << i << std::endl;
+        std::cout << "---------------------------------------------" << std::endl;
+
+        // Per-option statistics: an option is active until it terminates
+        std::vector<bool> active(agents.size());
+        std::vector<bool> success(agents.size(), false);
+        std::vector<unsigned> numberSteps(agents.size(), 0);
+        std::vector<double> totalReward(agents.size(), 0);
+
+        auto s = env.sensation();
+        abstraction.project(Eigen::Map<const Eigen::VectorXf>(&s[0], s.size()).cast<double>(), phi);
+        for (unsigned agentIdx = 0; agentIdx < agents.size(); agentIdx++) {
+            active[agentIdx] = !agents[agentIdx]->terminal(s);
+        }
+
+        // Main sense-act loop, until the behavior option terminates
+        while (active[behavior] && env.terminal() == false) {
+            int action = (rng.uniform() < epsilon) ? 
+                rng.uniformDiscrete(0, ContinuousRooms::NUM_ACTIONS-1) : 
+                learners[behavior]->getBestAction(phi);
+            float reward = env.apply(action);
+
+            s = env.sensation();
+            abstraction.project(Eigen::Map<const Eigen::VectorXf>(&s[0], s.size()).cast<double>(), phiPrime);
+            if (record) {
+                trajectory.push_back(cv::Point(s[4], s[5]));
+            }
+
+            for (unsigned agentIdx = 0; agentIdx < agents.size(); agentIdx++) {
+                if (!active[agentIdx]) {
+                    continue;
+                }
+
+                double pseudoReward = agents[agentIdx]->pseudoReward(reward, s);
+                bool terminal = agents[agentIdx]->terminal(s) || env.terminal();
+                learners[agentIdx]->learn(phi, action, pseudoReward, phiPrime, terminal);
+
+                numberSteps[agentIdx] += 1;
+                totalReward[agentIdx] += pseudoReward;
+                if (terminal) {
+                    active[agentIdx] = false;
+                    success[agentIdx] = (pseudoReward > 0);
+                }
+            }
+
+            std::swap(phi, phiPrime);
+        }
+
+        env.reset();
+        if (record) {
+            renderer->push(i, trajectory);
+        }
+
+        // Record statistics, over the part of the episode where each option was active
+        for (unsigned agentIdx = 0; agentIdx < agents.size(); agentIdx++) {
+            *statsFiles[agentIdx] << success[agentIdx] << " " << numberSteps[agentIdx] << " " << totalReward[agentIdx] << std::endl; 
+        }
+    }
+
+    // Save policies to file
+    for (unsigned agentIdx = 0; agentIdx < agents.size(); agentIdx++) {
+        std::stringstream ss;
+        ss << "agent" << agentIdx << "_options.rl"; 
+        learners[agentIdx]->savePolicy(ss.str());
+    }
+}
+
+/**
+ * Episode outcomes of the threads training the same option.
+ * Only this bookkeeping is locked, once per episode, never the weights.
+ */
+struct TrainingProgress
+{
+    /**
+     * @param window Number of most recent episodes over which the success rate is measured
+     * @param targetSuccessRate Success rate at which the option is considered learnt
+     * @param maxEpisodes Number of episodes after which the workers give up
+     */
+    TrainingProgress(unsigned window, double targetSuccessRate, unsigned maxEpisodes) :
+        window(window),
+        targetSuccessRate(targetSuccessRate),
+        maxEpisodes(maxEpisodes),
+        successes(0),
+        episodes(0),
+        converged(false),
+        done(false) {};
+
+    /**
+     * Record the outcome of an episode, and stop the workers
+     * once the target or the maximum number of episodes is reached
+     * @param success True if the option reached its subgoal
+     */
+    void push(bool success)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        recent.push_back(success);
+        successes += success;
+        if (recent.size() > window) {
+            successes -= recent.front();
+            recent.pop_front();
+        }
+        episodes += 1;
+
+        if (recent.size() == window && successes >= targetSuccessRate*window) {
+            converged = true;
+        }
+        if (converged || episodes >= maxEpisodes) {
+            done = true;
+        }
+    }
+
+    unsigned window;
+    double targetSuccessRate;
+    unsigned maxEpisodes;
+
+    std::deque<bool> recent;
+    unsigned successes;
+    unsigned episodes;
+    bool converged;
+
+    std::mutex mutex;
+    std::atomic<bool> done;
+};
+
+/**
+ * Run episodes of one option until the shared progress is done
+ * @param agent A Hogwild worker wrapped in the pseudo-reward function of the option
+ * @param env The environment of this worker
+ * @param progress The outcomes of every worker of the option
+ */
+void hogwildWorker(rl::RewardDecorator& agent, ContinuousRooms& env, TrainingProgress& progress)
+{
+    while (!progress.done) {
+        auto s = env.sensation();
+        auto reward = env.apply(agent.first_action(s));
+
+        while (!agent.terminal(s) && env.terminal() == false) {
+            s = env.sensation();
+            reward = env.apply(agent.next_action(reward, s));
+        }
+        agent.last_action(reward);
+
+        env.reset();
+        progress.push(reward > 0);
+    }
+}
+
+/**
+ * Learn one option with many threads, each with its own environment and
+ * random number streams, all updating the same action values without locks.
+ * @param learner The learner owning the action values
+ * @param abstraction The state abstraction of the learner, stateless and read-only, shared by the workers
+ * @param color The target color of the option
+ * @param map The layout of the world, shared by the environments
+ * @param space Where the robot can be in the map, shared by the environments
+ * @param numberThreads The number of workers
+ * @param progress Records the episodes of every worker
+ * @return The wall-clock time in seconds until the workers stopped
+ */
+double learnOptionHogwild(rl::LinearQ0Learner& learner, rl::sparse_state_abstraction& abstraction, int color, std::shared_ptr<const RoomsMap> map, std::shared_ptr<const ConfigurationSpace> space, unsigned numberThreads, TrainingProgress& progress)
+{
+    std::vector<std::unique_ptr<ContinuousRooms> > envs;
+    std::vector<std::unique_ptr<rl::LinearQ0Learner> > learners;
+    std::vector<std::unique_ptr<ReachNearestColorRewardDecorator> > agents;
+    for (unsigned t = 0; t < numberThreads; t++) {
+        envs.push_back(std::unique_ptr<ContinuousRooms>(new ContinuousRooms(map, space, true, Random(1000*t + 2*color + 2))));
+        learners.push_back(std::unique_ptr<rl::LinearQ0Learner>(new rl::LinearQ0Learner(learner, abstraction, Random(1000*t + 2*color + 1))));
+        agents.push_back(std::unique_ptr<ReachNearestColorRewardDecorator>(new ReachNearestColorRewardDecorator(*learners[t], color)));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < numberThreads; t++) {
+        workers.push_back(std::thread(hogwildWorker, std::ref(*agents[t]), std::ref(*envs[t]), std::ref(progress)));
+    }
+    for (auto it = workers.begin(); it != workers.end(); it++) {
+        it->join();
+    }
+
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Greedy policy of an option as seen by the actors, tagged
+ * with the number of updates made by the learner when taken
+ */
+struct PolicySnapshot
+{
+    PolicySnapshot(const Eigen::MatrixXd& thetas, unsigned long version) : thetas(thetas), version(version) {};
+    Eigen::MatrixXd thetas;
+    unsigned long version;
+};
+
+/**
+ * A transition generated by an actor, in the features of the learner
+ */
+struct Transition
+{
+    rl::sparse_features phi;
+    int action;
+    double reward;
+    rl::sparse_features phiPrime;
+    bool terminal;
+
+    // Version of the policy snapshot which chose the action
+    unsigned long policyVersion;
+};
+
+typedef rl::ExperienceQueue<Transition> TransitionQueue;
+
+/**
+ * Act epsilon-greedily in the environment with respect to the latest
+ * policy snapshot, and push the transitions for the learner
+ * @param option The pseudo-reward function and termination of the option
+ * @param env The environment of this actor
+ * @param abstraction The state abstraction of the learner
+ * @param queue The queue from this actor to the learner
+ * @param snapshot The latest policy published by the learner
+ * @param epsilon Probability of a random action
+ * @param rng Random number stream of this actor
+ * @param progress The outcomes of every actor of the option
+ */
+void pipelineActor(rl::RewardDecorator& option, ContinuousRooms& env, rl::sparse_state_abstraction& abstraction, TransitionQueue& queue, const std::shared_ptr<const PolicySnapshot>& snapshot, double epsilon, Random rng, TrainingProgress& progress)
+{
+    // Number of steps between two reads of the policy snapshot
+    const unsigned refreshSteps = 50;
+
+    std::shared_ptr<const PolicySnapshot> policy;
+    unsigned stepsSinceRefresh = refreshSteps;
+    Transition transition;
+    rl::sparse_features phi;
+
+    auto s = env.sensation();
+    abstraction.project(Eigen::Map<const Eigen::VectorXf>(&s[0], s.size()).cast<double>(), phi);
+
+    while (!progress.done) {
+        // Read the latest policy at the start of every episode and every refreshSteps steps
+        if (stepsSinceRefresh == refreshSteps) {
+            policy = std::atomic_load(&snapshot);
+            stepsSinceRefresh = 0;
+        }
+        stepsSinceRefresh += 1;
+
+        int action = 0;
+        if (rng.uniform() < epsilon) {
+            action = rng.uniformDiscrete(0, ContinuousRooms::NUM_ACTIONS-1);
+        } else {
+            rl::transposeProduct(policy->thetas, phi).maxCoeff(&action);
+        }
+        float reward = env.apply(action);
+
+        s = env.sensation();
+        transition.phi = phi;
+        transition.action = action;
+        transition.reward = option.pseudoReward(reward, s);
+        transition.terminal = option.terminal(s) || env.terminal();
+        transition.policyVersion = policy->version;
+        abstraction.project(Eigen::Map<const Eigen::VectorXf>(&s[0], s.size()).cast<double>(), transition.phiPrime);
+        phi = transition.phiPrime;
+
+        bool terminal = transition.terminal;
+        bool success = (transition.reward > 0);
+
+        // Wait for the learner rather than drop experience
+        while (!queue.push(transition) && !progress.done) {
+            std::this_thread::yield();
+        }
+
+        if (terminal) {
+            env.reset();
+            s = env.sensation();
+            abstraction.project(Eigen::Map<const Eigen::VectorXf>(&s[0], s.size()).cast<double>(), phi);
+            progress.push(success);
+            stepsSinceRefresh = refreshSteps;
+        }
+    }
+}
+
+/**
+ * Apply the transitions of every actor in batches, and publish a new
+ * policy snapshot at regular intervals. The mean queue depth and the
+ * mean and largest policy staleness, in number of updates, are written
+ * to the metrics stream every metricsEvery updates.
+ * @param learner The learner of the option
+ * @param queues One queue per actor
+ * @param snapshot Set to the latest policy
+ * @param batchSize Largest number of transitions taken from a queue at once
+ * @param refreshEvery Number of updates between two policy snapshots
+ * @param metricsEvery Number of updates between two lines of metrics
+ * @param metrics Receives the queue depth and staleness
+ * @param progress The outcomes of every actor of the option
+ */
+void pipelineLearner(rl::LinearQ0Learner& learner, std::vector<std::unique_ptr<TransitionQueue> >& queues, std::shared_ptr<const PolicySnapshot>& snapshot, unsigned batchSize, unsigned refreshEvery, unsigned metricsEvery, std::ostream& metrics, TrainingProgress& progress)
+{
+    Transition transition;
+    unsigned long updates = 0;
+
+    unsigned long depthSum = 0;
+    unsigned long depthSamples = 0;
+    unsigned long stalenessSum = 0;
+    unsigned long maxStaleness = 0;
+
+    while (!progress.done) {
+        bool idle = true;
+        for (auto it = queues.begin(); it != queues.end(); it++) {
+            depthSum += (*it)->size();
+            depthSamples += 1;
+
+            for (unsigned i = 0; i < batchSize && (*it)->pop(transition); i++) {
+                learner.learn(transition.phi, transition.action, transition.reward, transition.phiPrime, transition.terminal);
+                idle = false;
+
+                unsigned long staleness = updates - transition.policyVersion;
+                stalenessSum += staleness;
+                maxStaleness = std::max(maxStaleness, staleness);
+                updates += 1;
+
+                if (updates % refreshEvery == 0) {
+                    std::atomic_store(&snapshot, std::shared_ptr<const PolicySnapshot>(new PolicySnapshot(learner.getActionValueThetas(), updates)));
+                }
+
+                if (updates % metricsEvery == 0) {
+                    metrics << updates << " " << double(depthSum)/depthSamples << " " << double(stalenessSum)/metricsEvery << " " << maxStaleness << std::endl;
+                    depthSum = depthSamples = stalenessSum = maxStaleness = 0;
+                }
+            }
+        }
+
+        if (idle) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+/**
+ * Learn one option with an actor-learner pipeline: every actor thread
+ * steps its own environment and projects the states, and a single
+ * learner thread applies all the updates.
+ * @param learner The learner of the option
+ * @param option The pseudo-reward function and termination of the option
+ * @param abstraction The state abstraction of the learner
+ * @param color The target color of the option, used to seed the actors
+ * @param map The layout of the world, shared by the environments
+ * @param space Where the robot can be in the map, shared by the environments
+ * @param numberActors The number of actor threads
+ * @param metrics Receives the queue depth and staleness
+ * @param progress Records the episodes of every actor
+ * @return The wall-clock time in seconds until the threads stopped
+ */
+double learnOptionPipeline(rl::LinearQ0Learner& learner, rl::RewardDecorator& option, rl::sparse_state_abstraction& abstraction, int color, std::shared_ptr<const RoomsMap> map, std::shared_ptr<const ConfigurationSpace> space, unsigned numberActors, std::ostream& metrics, TrainingProgress& progress)
+{
+    const unsigned queueCapacity = 1024;
+    const unsigned batchSize = 32;
+    const unsigned refreshEvery = 1000;
+    const unsigned metricsEvery = 100000;
+
+    std::shared_ptr<const PolicySnapshot> snapshot(new PolicySnapshot(learner.getActionValueThetas(), 0));
+
+    std::vector<std::unique_ptr<ContinuousRooms> > envs;
+    std::vector<std::unique_ptr<TransitionQueue> > queues;
+    for (unsigned t = 0; t < numberActors; t++) {
+        envs.push_back(std::unique_ptr<ContinuousRooms>(new ContinuousRooms(map, space, true, Random(1000*t + 2*color + 2))));
+        queues.push_back(std::unique_ptr<TransitionQueue>(new TransitionQueue(queueCapacity)));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> actors;
+    for (unsigned t = 0; t < numberActors; t++) {
+        actors.push_back(std::thread(pipelineActor, std::ref(option), std::ref(*envs[t]), std::ref(abstraction), std::ref(*queues[t]), std::cref(snapshot), 0.1, Random(1000*t + 2*color + 1), std::ref(progress)));
+    }
+    pipelineLearner(learner, queues, snapshot, batchSize, refreshEvery, metricsEvery, metrics, progress);
+
+    for (auto it = actors.begin(); it != actors.end(); it++) {
+        it->join();
+    }
+
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * A sweep of the poses the robot can reach: the center of every
+ * free cell of the configuration space, facing each of the 12 headings
+ * the turns lead to, and sensing the color of the floor underneath.
+ * @param map The layout of the world
+ * @param space Where the robot can be in the map
+ * @return The state vectors, one per column
+ */
+Eigen::MatrixXd reachableStates(const RoomsMap& map, const ConfigurationSpace& space)
+{
+    const int numberHeadings = 12;
+
+    Eigen::MatrixXd states = Eigen::MatrixXd::Zero(7, space.freeCells.size()*numberHeadings);
+    int j = 0;
+    for (auto it = space.freeCells.begin(); it != space.freeCells.end(); it++) {
+        double x = it->x + 0.5;
+        double y = it->y + 0.5;
+        uchar label = map.label(x, y);
+
+        for (int k = 0; k < numberHeadings; k++, j++) {
+            if (label < ContinuousRooms::NUM_COLORS) {
+                states(label, j) = 1;
+            }
+            states(4, j) = x;
+            states(5, j) = y;
+            states(6, j) = k*M_PI/6.0;
+        }
+    }
+    return states;
+}
+
+/**
+ * Usage: learn_options [--parallel | --multigoal | --hogwild N | --pipeline N | --static | --calibrate] [--tile-coding] [--compact] [--headless] [--render-every N]
+ * With --parallel, every option is learnt on its own thread
+ * with its own environment and random number stream.
+ * With --multigoal, every option is learnt off-policy from
+ * the same stream of experience.
+ * With --hogwild N, every option is learnt in turn by 1, 2, 4, ..., N
+ * threads sharing its weights without locks. The wall-clock time to
+ * reach the target success rate is reported for every number of threads
+ * in hogwild_scaling.dat, and the policies learnt with N threads are saved.
+ * With --pipeline N, every option is learnt in turn by N actor threads
+ * feeding transitions to one learner thread. The queue depth and policy
+ * staleness are written to agent<i>_pipeline.dat.
+ * With --static, every option is learnt in turn by a learner specialized at
+ * compile time for the tile coding, with float weights and the pseudo-reward
+ * inlined into its steps, called without going through the Agent interface.
+ * With --calibrate, nothing is learnt: the policies saved by a previous run
+ * with the same basis are loaded in float and in 8 bits weights, and the
+ * agreement of their greedy actions with the double precision weights over
+ * the reachable states is reported with the size of the weights.
+ * With --tile-coding, the basis is a tile coding of the same resolution as
+ * the RBF in 8 tilings, whose binary features are much cheaper to update.
+ * With --compact, the features which cannot activate in the free space
+ * of the map and the duplicated features are removed from the basis.
+ * With --headless, nothing is drawn on screen during learning.
+ * With --render-every N, the trajectory of every Nth episode is
+ * drawn on a background thread and saved as an image.
+ */
+int main(int argc, char** argv)
+{
+std::string mode;
+bool headless = false;
+bool compact = false;
+bool tileCoding = false;
+unsigned renderEvery = 0;
+unsigned hogwildThreads = 0;
+unsigned pipelineActors = 0;
+for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "--headless") {
+        headless = true;
+    } else if (arg == "--compact") {
+        compact = true;
+    } else if (arg == "--tile-coding") {
+        tileCoding = true;
+    } else if (arg == "--render-every" && i + 1 < argc) {
+        renderEvery = std::atoi(argv[++i]);
+    } else if (arg == "--hogwild" && i + 1 < argc) {
+        mode = arg;
+        hogwildThreads = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--pipeline" && i + 1 < argc) {
+        mode = arg;
+        pipelineActors = std::max(1, std::atoi(argv[++i]));
+    } else {
+        mode = arg;
+    }
+}
+bool parallel = (mode == "--parallel");
+
+// Radial-basis functions are placed every 10 units in 
+// in the x and y dimensions and every 30 degrees
+rl::grid_axis xyAxis(10.2/2.0, 10, 20);
+rl::grid_axis psiAxis(0, 30, 13);
+Eigen::Vector3d C(1.0/10.2, 1.0/10.2, 1/30);
+rl::grid_rbf_abstraction rbfBasis(xyAxis, xyAxis, psiAxis, C, 20);
+
+// Tiles of 10 units and 30 degrees over the whole map
+rl::tile_coding_abstraction tileBasis(Eigen::Vector2d(0, 0), Eigen::Vector2d(200, 200), Eigen::Vector3d(10, 10, M_PI/6.0), 8);
+rl::sparse_state_abstraction& basis = tileCoding ? (rl::sparse_state_abstraction&) tileBasis : rbfBasis;
+
+// We use a virtual world of 200x200 units with a 10 units wide robot
+const double robotRadius = 5;
+std::shared_ptr<const RoomsMap> map(new RoomsMap("map.png"));
+std::shared_ptr<const ConfigurationSpace> space(new ConfigurationSpace(*map, robotRadius));
+cv::Mat img = cv::imread("map.png");
+
+// The color indicators are kept in place for the terminations
+std::unique_ptr<rl::compact_abstraction> compactBasis(compact ? new rl::compact_abstraction(basis, reachableStates(*map, *space), ContinuousRooms::NUM_COLORS) : 0);
+rl::sparse_state_abstraction& stateAbstraction = compact ? (rl::sparse_state_abstraction&) *compactBasis : basis;
+if (compact) {
+    std::cout << "Compacted the basis from " << basis.length() << " to " << stateAbstraction.length() << " features" << std::endl;
+}
+
+// Instantiate agents for learning a policy for reaching 
+// the subgoals defined by the pseudo-reward functions
+std::vector<rl::RewardDecorator*> agents;
+for (int color = 0; color < ContinuousRooms::NUM_COLORS; color++) {
+    Random rng = parallel ? Random(2*color + 1) : Random();
+    agents.push_back(new ReachNearestColorRewardDecorator(*(new rl::LinearQ0Learner(ContinuousRooms::NUM_ACTIONS, 5e-4, 0.1, 0.9, stateAbstraction, rng)), color));
+}
+
+// Train a separate agent for each option and take the resulting policy
+const unsigned numberLearningEpisodes = 1e5; 
+
+if (mode == "--multigoal") {
+    ContinuousRooms env(map, space, true);
+    std::unique_ptr<TrajectoryRenderer> renderer(renderEvery ? new TrajectoryRenderer(img, "behavior_episode", renderEvery) : 0);
+    learnOptionsFromSharedExperience(agents, env, stateAbstraction, numberLearningEpisodes, 0.1, Random(), renderer.get());
+    return 0;
+}
+
+if (mode == "--hogwild") {
+    // Success rate over the last 100 episodes of all the workers
+    const unsigned window = 100;
+    const double targetSuccessRate = 0.9;
+
+    std::ofstream scalingFile("hogwild_scaling.dat");
+    for (unsigned numberThreads = 1; ; numberThreads = std::min(2*numberThreads, hogwildThreads)) {
+        for (int color = 0; color < ContinuousRooms::NUM_COLORS; color++) {
+            rl::LinearQ0Learner learner(ContinuousRooms::NUM_ACTIONS, 5e-4, 0.1, 0.9, stateAbstraction, Random(2*color + 1));
+            TrainingProgress progress(window, targetSuccessRate, numberLearningEpisodes);
+            double seconds = learnOptionHogwild(learner, stateAbstraction, color, map, space, numberThreads, progress);
+
+            // Threads, option, seconds, episodes, target reached
+            std::cout << "Threads " << numberThreads << " Agent " << color << " " << seconds << "s " << progress.episodes << " episodes" << (progress.converged ? "" : " (target not reached)") << std::endl;
+            scalingFile << numberThreads << " " << color << " " << seconds << " " << progress.episodes << " " << progress.converged << std::endl;
+
+            if (numberThreads == hogwildThreads) {
+                std::stringstream ss;
+                ss << "agent" << color << "_options.rl"; 
+                learner.savePolicy(ss.str());
+            }
+        }
+
+        if (numberThreads == hogwildThreads) {
+            break;
+        }
+    }
+    return 0;
+}
+
+if (mode == "--pipeline") {
+    for (int color = 0; color < ContinuousRooms::NUM_COLORS; color++) {
+        rl::LinearQ0Learner* learner = (rl::LinearQ0Learner*) agents[color]->getAgent();
+        TrainingProgress progress(100, 0.9, numberLearningEpisodes);
+
+        std::stringstream ss;
+        ss << "agent" << color; 
+        std::ofstream metricsFile(ss.str() + "_pipeline.dat");
+
+        double seconds = learnOptionPipeline(*learner, *agents[color], stateAbstraction, color, map, space, pipelineActors, metricsFile, progress);
+        std::cout << "Actors " << pipelineActors << " Agent " << color << " " << seconds << "s " << progress.episodes << " episodes" << (progress.converged ? "" : " (target not reached)") << std::endl;
+
+        learner->savePolicy(ss.str() + "_options.rl");
+    }
+    return 0;
+}
+
+if (mode == "--static") {
+    typedef rl::StaticLinearQ0Learner<rl::tile_coding_abstraction, float> StaticLearner;
+    for (int color = 0; color < ContinuousRooms::NUM_COLORS; color++) {
+        StaticLearner learner(ContinuousRooms::NUM_ACTIONS, 5e-4, 0.1, 0.9, tileBasis, Random(2*color + 1));
+        rl::StaticRewardDecorator<StaticLearner, ReachNearestColorShaping> agent(learner, ReachNearestColorShaping(color));
+        ContinuousRooms env(map, space, true);
+
+        auto start = std::chrono::steady_clock::now();
+        learnOptionStatic(agent, env, color, numberLearningEpisodes);
+        std::cout << "Agent " << color << " " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << "s" << std::endl;
+    }
+    return 0;
+}
+
+if (mode == "--calibrate") {
+    Eigen::MatrixXd states = reachableStates(*map, *space);
+    for (int color = 0; color < ContinuousRooms::NUM_COLORS; color++) {
+        std::stringstream ss;
+        ss << "agent" << color << "_options.rl"; 
+        rl::LinearQ0Learner learner(ContinuousRooms::NUM_ACTIONS, 5e-4, 0.1, 0.9, stateAbstraction);
+        learner.loadPolicy(ss.str());
+
+        rl::LinearOption option;
+        option.setActionValueThetas(learner.getActionValueThetas());
+        std::cout << "Agent " << color << " double: " << option.inferenceBytes() << " bytes" << std::endl;
+
+        const rl::policy_precision precisions[] = {rl::FLOAT_POLICY, rl::INT8_POLICY};
+        const char* names[] = {"float", "int8"};
+        for (int p = 0; p < 2; p++) {
+            rl::policy_calibration calibration = option.calibrate(precisions[p], stateAbstraction, states);
+            option.setPolicyPrecision(precisions[p]);
+            std::cout << "Agent " << color << " " << names[p] << ": " << option.inferenceBytes() << " bytes, "
+                      << 100*calibration.agreement << "% greedy actions agree" << std::endl;
+        }
+    }
+    return 0;
+}
+
+// One renderer per agent, so that every agent keeps its own sampled episodes
+std::vector<std::unique_ptr<TrajectoryRenderer> > renderers;
+for (unsigned agentIdx = 0; agentIdx < agents.size(); agentIdx++) {
+    std::stringstream ss;
+    ss << "agent" << agentIdx << "_episode"; 
+    renderers.push_back(std::unique_ptr<TrajectoryRenderer>(renderEvery ? new TrajectoryRenderer(img, ss.str(), renderEvery) : 0));
+}
+
+if (!parallel) {
+    ContinuousRooms env(map, space, true);
+    for (unsigned agentIdx = 0; agentIdx < agents.size(); agentIdx++) {
+        learnOption(*agents[agentIdx], env, agentIdx, numberLearningEpisodes, !headless, renderers[agentIdx].get());
+    }
+    return 0;
+}
+
+// The map and the state abstraction are read-only and shared by the workers
+std::vector<std::unique_ptr<ContinuousRooms> > envs;
+std::vector<std::thread> workers;
+for (unsigned agentIdx = 0; agentIdx < agents.size(); agentIdx++) {
+    envs.push_back(std::unique_ptr<ContinuousRooms>(new ContinuousRooms(map, space, true, Random(2*agentIdx + 2))));
+    workers.push_back(std::thread(learnOption, std::ref(*agents[agentIdx]), std::ref(*envs[agentIdx]), agentIdx, numberLearningEpisodes, false, renderers[agentIdx].get()));
+}
 
-    agentIdx += 1;
+for (auto it = workers.begin(); it != workers.end(); it++) {
+    it->join();
 }
 
 return 0;
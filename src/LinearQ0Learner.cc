@@ -1,36 +1,64 @@
 #include <linear_options/LinearQ0Learner.hh>
 #include <linear_options/serialization.hh>
+#include <linear_options/BinaryArchive.hh>
+
+#include <stdexcept>
 
 using namespace rl;
 
 LinearQ0Learner::LinearQ0Learner(unsigned numActions, double alpha, double epsilon, double gamma, rl::state_abstraction& abstraction, Random rng) : 
+        sharedThetas(new Eigen::MatrixXd(Eigen::MatrixXd::Zero(abstraction.length(), numActions))),
+        actionValueThetas(*sharedThetas),
         numActions(numActions), 
         alpha(alpha),
         epsilon(epsilon),
         gamma(gamma),
         stateAbstraction(&abstraction),
+        sparseAbstraction(dynamic_cast<rl::sparse_state_abstraction*>(&abstraction)),
+        binaryAbstraction(dynamic_cast<rl::binary_state_abstraction*>(&abstraction)),
+        rng(rng)
+{ 
+}
+
+LinearQ0Learner::LinearQ0Learner(LinearQ0Learner& shared, rl::state_abstraction& abstraction, Random rng) : 
+        sharedThetas(shared.sharedThetas),
+        actionValueThetas(*sharedThetas),
+        numActions(shared.numActions), 
+        alpha(shared.alpha),
+        epsilon(shared.epsilon),
+        gamma(shared.gamma),
+        stateAbstraction(&abstraction),
+        sparseAbstraction(dynamic_cast<rl::sparse_state_abstraction*>(&abstraction)),
+        binaryAbstraction(dynamic_cast<rl::binary_state_abstraction*>(&abstraction)),
         rng(rng)
 { 
-    actionValueThetas.resize(numActions); 
-    for (auto it = actionValueThetas.begin(); it != actionValueThetas.end(); it++) {
-        (*it) = Eigen::VectorXd::Zero(stateAbstraction->length());
+    if (abstraction.length() != actionValueThetas.rows()) {
+        throw std::invalid_argument("The abstraction of a worker must have as many features as the shared action values");
     }
 }
 
 int LinearQ0Learner::getBestAction(const Eigen::VectorXd& phi) 
 {
-    double maxAction = 0;
-    double maxValue = -1*std::numeric_limits<double>::max();
+    // All the action values at once, in a single matrix-vector product
+    int maxAction = 0;
+    transposeProduct(actionValueThetas, phi, actionValues);
+    actionValues.maxCoeff(&maxAction);
+    return maxAction;
+}
 
-    for (unsigned i = 0; i < actionValueThetas.size(); i++) {
-       double value = actionValueThetas[i].dot(phi);
-       if (value > maxValue) {
-           maxAction = i;
-           maxValue = value;
-       }
-    }
+int LinearQ0Learner::getBestAction(const sparse_features& phi) 
+{
+    int maxAction = 0;
+    transposeProduct(actionValueThetas, phi, actionValues);
+    actionValues.maxCoeff(&maxAction);
+    return maxAction;
+}
 
-    //std::cout << "Best action is " << maxAction << " with value " << maxValue << std::endl;
+int LinearQ0Learner::getBestAction(const binary_features& phi) 
+{
+    int maxAction = 0;
+    transposeProduct(actionValueThetas, phi, actionValues);
+    actionValues.maxCoeff(&maxAction);
     return maxAction;
 }
 
@@ -42,19 +70,88 @@ int LinearQ0Learner::epsilonGreedy(const Eigen::VectorXd& phi)
     return lastAction;
 }
 
+int LinearQ0Learner::epsilonGreedy(const sparse_features& phi)
+{
+    lastAction  = (rng.uniform() < epsilon) ? rng.uniformDiscrete(0, numActions-1) : getBestAction(phi); 
+
+    lastSparsePhi = phi;
+    return lastAction;
+}
+
+int LinearQ0Learner::epsilonGreedy(const binary_features& phi)
+{
+    lastAction  = (rng.uniform() < epsilon) ? rng.uniformDiscrete(0, numActions-1) : getBestAction(phi); 
+
+    lastBinaryPhi = phi;
+    return lastAction;
+}
+
+template<class Features>
+void LinearQ0Learner::tdUpdate(int action, double target, const Features& phi)
+{
+    axpy(alpha*(target - dot(actionValueThetas.col(action), phi)), phi, actionValueThetas.col(action));
+}
+
+template<class Features>
+double LinearQ0Learner::maxValue(const Features& phiPrime)
+{
+    transposeProduct(actionValueThetas, phiPrime, actionValues);
+    return actionValues.maxCoeff();
+}
+
+void LinearQ0Learner::learn(const Eigen::VectorXd& phi, int action, double reward, const Eigen::VectorXd& phiPrime, bool terminal)
+{
+    tdUpdate(action, terminal ? reward : reward + gamma*maxValue(phiPrime), phi);
+}
+
+void LinearQ0Learner::learn(const sparse_features& phi, int action, double reward, const sparse_features& phiPrime, bool terminal)
+{
+    tdUpdate(action, terminal ? reward : reward + gamma*maxValue(phiPrime), phi);
+}
+
+void LinearQ0Learner::learn(const binary_features& phi, int action, double reward, const binary_features& phiPrime, bool terminal)
+{
+    tdUpdate(action, terminal ? reward : reward + gamma*maxValue(phiPrime), phi);
+}
+
 int LinearQ0Learner::first_action(const std::vector<float> &s)
 {
-    auto phi = project(s);
-    return epsilonGreedy(phi);
+    stateAbstraction->reset();
+    if (binaryAbstraction) {
+        project(s, binaryPhiPrime);
+        return epsilonGreedy(binaryPhiPrime);
+    }
+
+    if (sparseAbstraction) {
+        project(s, sparsePhiPrime);
+        return epsilonGreedy(sparsePhiPrime);
+    }
+
+    project(s, phiPrime);
+    return epsilonGreedy(phiPrime);
 }
 
 int LinearQ0Learner::next_action(float reward, const std::vector<float> &s)
 {
-    auto phiPrime = project(s);
+    if (binaryAbstraction) {
+        // Only the weights of the active features are gathered and updated
+        project(s, binaryPhiPrime);
+        tdUpdate(lastAction, reward + gamma*maxValue(binaryPhiPrime), lastBinaryPhi);
+        return epsilonGreedy(binaryPhiPrime);
+    }
 
-    actionValueThetas[lastAction] = actionValueThetas[lastAction].array() + lastPhi.array()*(reward + gamma*actionValueThetas[getBestAction(phiPrime)].dot(phiPrime) - actionValueThetas[lastAction].dot(lastPhi))*alpha;
+    if (sparseAbstraction) {
+        // Only the active features are read and updated
+        project(s, sparsePhiPrime);
+        tdUpdate(lastAction, reward + gamma*maxValue(sparsePhiPrime), lastSparsePhi);
+        return epsilonGreedy(sparsePhiPrime);
+    }
 
-    //std::cout << "Error " << actionValueThetas[getBestAction(phiPrime)].dot(phiPrime) - actionValueThetas[lastAction].dot(lastPhi) << std::endl;
+    project(s, phiPrime);
+
+    tdUpdate(lastAction, reward + gamma*maxValue(phiPrime), lastPhi);
+
+    //std::cout << "Error " << maxValue(phiPrime) - actionValueThetas.col(lastAction).dot(lastPhi) << std::endl;
 
     return epsilonGreedy(phiPrime);
 }
@@ -62,7 +159,13 @@ int LinearQ0Learner::next_action(float reward, const std::vector<float> &s)
 void LinearQ0Learner::last_action(float reward)
 {
     std::cerr << "**************************************************** EXECUTING LAST ACTION" << std::endl;
-    actionValueThetas[lastAction] = actionValueThetas[lastAction].array() + lastPhi.array()*(reward - actionValueThetas[lastAction].dot(lastPhi))*alpha;
+    if (binaryAbstraction) {
+        tdUpdate(lastAction, reward, lastBinaryPhi);
+    } else if (sparseAbstraction) {
+        tdUpdate(lastAction, reward, lastSparsePhi);
+    } else {
+        tdUpdate(lastAction, reward, lastPhi);
+    }
 }
 
 void LinearQ0Learner::setDebug(bool d) 
@@ -73,12 +176,40 @@ void LinearQ0Learner::savePolicy(const std::string& filename)
 {
     std::ofstream file(filename); 
     boost::archive::text_oarchive oa(file);
-    oa << actionValueThetas;
+    const std::vector<Eigen::VectorXd> thetas = columns(actionValueThetas);
+    oa << thetas;
+}
+
+void LinearQ0Learner::saveBinaryPolicy(const std::string& filename)
+{
+    std::vector<binary_array> arrays;
+    arrays.push_back(binary_array(actionValueThetas));
+    saveBinary(filename, BINARY_POLICY, arrays);
 }
 
 void LinearQ0Learner::loadPolicy(const std::string& filename)
 {
+    if (isBinaryArchive(filename)) {
+        MappedArchive archive(filename);
+        if (archive.kind() != BINARY_POLICY || archive.size() != 1) {
+            throw std::runtime_error("Not a policy archive " + filename);
+        }
+        if (archive.matrix(0).rows() != stateAbstraction->length() || archive.matrix(0).cols() != int(numActions)) {
+            throw std::runtime_error("Not a policy for these features and actions " + filename);
+        }
+
+        actionValueThetas = archive.matrix(0);
+        return;
+    }
+
     std::ifstream ifs(filename, std::ios::binary);
     boost::archive::text_iarchive ia(ifs);
-    ia >> actionValueThetas;
+    std::vector<Eigen::VectorXd> thetas;
+    ia >> thetas;
+
+    Eigen::MatrixXd loaded = fromColumns(thetas);
+    if (loaded.rows() != stateAbstraction->length() || loaded.cols() != int(numActions)) {
+        throw std::runtime_error("Not a policy for these features and actions " + filename);
+    }
+    actionValueThetas = loaded;
 }
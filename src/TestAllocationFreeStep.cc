@@ -0,0 +1,242 @@
+#include <linear_options/LinearQ0Learner.hh>
+#include <linear_options/DynaLOEMAgent.hh>
+#include <linear_options/RoomAbstraction.hh>
+#include <linear_options/BinaryArchive.hh>
+#include <linear_options/StaticAgents.hh>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+
+/**
+ * Count the heap allocations of the whole process while enabled.
+ * malloc is replaced rather than operator new, so that the allocations
+ * made by Eigen are counted as well. Relies on the glibc entry points.
+ * Atomic, as the background planning threads allocate through it too.
+ */
+static std::atomic<bool> countAllocations(false);
+static std::atomic<unsigned long> allocations(0);
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* p);
+
+void* malloc(size_t size) { allocations += countAllocations; return __libc_malloc(size); }
+void* calloc(size_t n, size_t size) { allocations += countAllocations; return __libc_calloc(n, size); }
+void* realloc(void* p, size_t size) { allocations += countAllocations; return __libc_realloc(p, size); }
+void* memalign(size_t alignment, size_t size) { allocations += countAllocations; return __libc_memalign(alignment, size); }
+void* aligned_alloc(size_t alignment, size_t size) { allocations += countAllocations; return __libc_memalign(alignment, size); }
+int posix_memalign(void** p, size_t alignment, size_t size)
+{
+    allocations += countAllocations;
+    *p = __libc_memalign(alignment, size);
+    return *p ? 0 : ENOMEM;
+}
+void free(void* p) { __libc_free(p); }
+}
+
+/**
+ * Hides the sparse interface of an abstraction, so that the agents take their dense path
+ */
+struct dense_abstraction : public rl::state_abstraction
+{
+    dense_abstraction(rl::sparse_state_abstraction& abstraction) : abstraction(abstraction) {};
+
+    Eigen::VectorXd operator()(const Eigen::VectorXd& s) { return abstraction(s); }
+
+    void project(const Eigen::VectorXd& s, Eigen::VectorXd& phi)
+    {
+        abstraction.project(s, active);
+        active.toDense(phi);
+    }
+
+    int length() { return abstraction.length(); }
+
+    rl::sparse_state_abstraction& abstraction;
+    rl::sparse_features active;
+};
+
+/**
+ * Run the agent once over the states to let its workspaces grow,
+ * then once more while counting the allocations
+ * @return True if the second pass did not allocate
+ */
+bool allocationFree(const std::string& name, Agent& agent, const std::vector<std::vector<float> >& states)
+{
+    agent.first_action(states[0]);
+    for (unsigned i = 1; i < states.size(); i++) {
+        agent.next_action(-1, states[i]);
+    }
+
+    allocations = 0;
+    countAllocations = true;
+    for (unsigned i = 0; i < states.size(); i++) {
+        agent.next_action(-1, states[i]);
+    }
+    countAllocations = false;
+
+    std::cout << name << ": " << allocations.load() << " allocations in " << states.size() << " steps" << std::endl;
+    return allocations == 0;
+}
+
+int main(void)
+{
+// The archives of the agents are written to a directory of their own, removed at exit
+char directory[] = "/tmp/allocation_test.XXXXXX";
+if (!mkdtemp(directory)) {
+    std::cout << "FAILED: cannot create a temporary directory" << std::endl;
+    return 1;
+}
+const std::string optionsFile = std::string(directory) + "/options.bin";
+const std::string modelsFile = std::string(directory) + "/models.bin";
+const std::string tileOptionsFile = std::string(directory) + "/tile_options.bin";
+const std::string tileModelsFile = std::string(directory) + "/tile_models.bin";
+
+// A coarse grid, so that the dense transition models stay small
+rl::grid_axis xyAxis(20, 40, 5);
+rl::grid_axis psiAxis(0, 90, 4);
+Eigen::Vector3d C(1.0/40, 1.0/40, 1.0/90);
+rl::grid_rbf_abstraction sparseAbstraction(xyAxis, xyAxis, psiAxis, C, 20);
+dense_abstraction denseAbstraction(sparseAbstraction);
+const int n = sparseAbstraction.length();
+const int numActions = 3;
+
+// States in the layout of ContinuousRooms::sensation
+Random rng(1);
+std::vector<std::vector<float> > states(500, std::vector<float>(7, 0));
+for (unsigned i = 0; i < states.size(); i++) {
+    states[i][rng.uniformDiscrete(0, 3)] = 1;
+    states[i][4] = rng.uniform()*200;
+    states[i][5] = rng.uniform()*200;
+    states[i][6] = rng.uniformDiscrete(0, 11)*30;
+}
+
+// Four options with random policies and models
+std::vector<rl::binary_array> options;
+std::vector<rl::binary_array> models;
+std::vector<Eigen::MatrixXd> storage;
+for (int o = 0; o < 4; o++) {
+    storage.push_back(Eigen::MatrixXd::Random(n, numActions));
+    storage.push_back(Eigen::MatrixXd::Random(n, 1));
+    storage.push_back(1e-2*Eigen::MatrixXd::Random(n, n));
+    storage.push_back(Eigen::MatrixXd::Random(n, 1));
+}
+for (unsigned i = 0; i < storage.size(); i += 4) {
+    options.push_back(rl::binary_array(storage[i]));
+    options.push_back(rl::binary_array(storage[i + 1]));
+    models.push_back(rl::binary_array(storage[i + 2]));
+    models.push_back(rl::binary_array(storage[i + 3]));
+}
+rl::saveBinary(optionsFile, rl::BINARY_OPTIONS, options);
+rl::saveBinary(modelsFile, rl::BINARY_OPTION_MODELS, models);
+
+bool passed = true;
+
+rl::LinearQ0Learner sparseLearner(numActions, 5e-4, 0.1, 0.9, sparseAbstraction);
+passed &= allocationFree("LinearQ0Learner, sparse features", sparseLearner, states);
+
+rl::LinearQ0Learner denseLearner(numActions, 5e-4, 0.1, 0.9, denseAbstraction);
+passed &= allocationFree("LinearQ0Learner, dense features", denseLearner, states);
+
+for (int dense = 0; dense < 2; dense++) {
+    rl::state_abstraction& abstraction = dense ? (rl::state_abstraction&) denseAbstraction : sparseAbstraction;
+    std::string features = dense ? ", dense features" : ", sparse features";
+
+    rl::DynaLOEMAgent agent(numActions, 1e-3, 0.1, 0.9, abstraction, optionsFile, modelsFile);
+    passed &= allocationFree("DynaLOEMAgent" + features, agent, states);
+
+    rl::DynaLOEMAgent factored(numActions, 1e-3, 0.1, 0.9, abstraction, optionsFile, modelsFile, Random(), 8);
+    passed &= allocationFree("DynaLOEMAgent, factored models" + features, factored, states);
+
+    rl::DynaLOEMAgent leastSquares(numActions, 1e-3, 0.1, 0.9, abstraction, optionsFile, modelsFile);
+    leastSquares.setLeastSquaresModels();
+    passed &= allocationFree("DynaLOEMAgent, least-squares models" + features, leastSquares, states);
+
+    // Fewer visited states than steps, so that the memory is full after the first pass
+    rl::DynaLOEMAgent planning(numActions, 1e-3, 0.1, 0.9, abstraction, optionsFile, modelsFile);
+    planning.setPlanning(5, 0, 100);
+    passed &= allocationFree("DynaLOEMAgent, planning" + features, planning, states);
+
+    // Every step locks the options and wakes the planning threads, whose updates are counted too
+    rl::DynaLOEMAgent background(numActions, 1e-3, 0.1, 0.9, abstraction, optionsFile, modelsFile);
+    background.setPlanning(5, 2, 100);
+    passed &= allocationFree("DynaLOEMAgent, background planning" + features, background, states);
+
+    rl::DynaLOEMAgent sweeping(numActions, 1e-3, 0.1, 0.9, abstraction, optionsFile, modelsFile);
+    sweeping.setPrioritizedPlanning(5);
+    passed &= allocationFree("DynaLOEMAgent, prioritized sweeping" + features, sweeping, states);
+}
+
+// Binary features, with options and factored models of their own size
+rl::tile_coding_abstraction tiles(Eigen::Vector2d(0, 0), Eigen::Vector2d(200, 200), Eigen::Vector3d(50, 50, M_PI/2), 2);
+const int tileCount = tiles.length();
+std::vector<rl::binary_array> tileOptions;
+std::vector<Eigen::MatrixXd> tileStorage;
+for (int o = 0; o < 4; o++) {
+    tileStorage.push_back(Eigen::MatrixXd::Random(tileCount, numActions));
+    tileStorage.push_back(Eigen::MatrixXd::Random(tileCount, 1));
+}
+for (unsigned i = 0; i < tileStorage.size(); i++) {
+    tileOptions.push_back(rl::binary_array(tileStorage[i]));
+}
+rl::saveBinary(tileOptionsFile, rl::BINARY_OPTIONS, tileOptions);
+
+std::vector<rl::binary_array> tileModels;
+std::vector<Eigen::MatrixXd> tileModelStorage;
+for (int o = 0; o < 4; o++) {
+    tileModelStorage.push_back(1e-2*Eigen::MatrixXd::Random(tileCount, 8));
+    tileModelStorage.push_back(1e-2*Eigen::MatrixXd::Random(tileCount, 8));
+    tileModelStorage.push_back(Eigen::MatrixXd::Random(tileCount, 1));
+}
+for (unsigned i = 0; i < tileModelStorage.size(); i++) {
+    tileModels.push_back(rl::binary_array(tileModelStorage[i]));
+}
+rl::saveBinary(tileModelsFile, rl::BINARY_FACTORED_OPTION_MODELS, tileModels);
+
+rl::LinearQ0Learner tileLearner(numActions, 5e-4, 0.1, 0.9, tiles);
+passed &= allocationFree("LinearQ0Learner, binary features", tileLearner, states);
+
+rl::DynaLOEMAgent tileAgent(numActions, 1e-3, 0.1, 0.9, tiles, tileOptionsFile, tileModelsFile);
+tileAgent.setPlanning(5, 0, 100);
+passed &= allocationFree("DynaLOEMAgent, factored models and planning, binary features", tileAgent, states);
+
+rl::StaticLinearQ0Learner<rl::grid_rbf_abstraction, float> staticLearner(numActions, 5e-4, 0.1, 0.9, sparseAbstraction);
+passed &= allocationFree("StaticLinearQ0Learner, sparse features", staticLearner, states);
+
+rl::StaticLinearQ0Learner<rl::tile_coding_abstraction, float> staticTileLearner(numActions, 5e-4, 0.1, 0.9, tiles);
+passed &= allocationFree("StaticLinearQ0Learner, binary features", staticTileLearner, states);
+
+std::vector<rl::LinearOption*> staticOptions;
+for (unsigned i = 0; i < tileStorage.size(); i += 2) {
+    staticOptions.push_back(new rl::LinearOption());
+    staticOptions.back()->setActionValueThetas(tileStorage[i]);
+    staticOptions.back()->theta = tileStorage[i + 1];
+}
+std::vector<int> indicators;
+for (unsigned o = 0; o < staticOptions.size(); o++) {
+    indicators.push_back(o);
+}
+rl::StaticLOEMAgent<rl::tile_coding_abstraction, rl::indicator_termination, float> staticAgent(staticOptions, 1e-3, 0.1, 0.9, tiles, rl::indicator_termination(indicators));
+passed &= allocationFree("StaticLOEMAgent, binary features", staticAgent, states);
+for (unsigned o = 0; o < staticOptions.size(); o++) {
+    delete staticOptions[o];
+}
+
+std::remove(optionsFile.c_str());
+std::remove(modelsFile.c_str());
+std::remove(tileOptionsFile.c_str());
+std::remove(tileModelsFile.c_str());
+rmdir(directory);
+
+if (!passed) {
+    std::cout << "FAILED: a step allocated memory" << std::endl;
+    return 1;
+}
+return 0;
+}
@@ -0,0 +1,95 @@
+#include <linear_options/ContinuousRoomsBatch.hh>
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+/**
+ * Draw mostly forward moves, so that the robots cover the map
+ */
+int randomAction(Random& rng)
+{
+    return rng.uniform() < 0.8 ? ContinuousRooms::FORWARD : rng.uniformDiscrete(ContinuousRooms::LEFT, ContinuousRooms::RIGHT);
+}
+
+int main(void)
+{
+std::shared_ptr<const RoomsMap> map(new RoomsMap("map.png"));
+std::shared_ptr<const ConfigurationSpace> space(new ConfigurationSpace(*map, 5));
+
+bool passed = true;
+
+// Every robot of the batch follows the same trajectory as a single environment
+// seeded like its stream, whatever the other robots do. The single environment
+// stays terminal until it is reset, whereas the batch resets the robot within the step.
+const unsigned numberSteps = 20000;
+const unsigned numberEnvironments = 8;
+std::vector<Random> streams;
+std::vector<ContinuousRooms*> envs;
+for (unsigned i = 0; i < numberEnvironments; i++) {
+    streams.push_back(Random(7 + i));
+    envs.push_back(new ContinuousRooms(map, space, true, Random(7 + i)));
+}
+ContinuousRoomsBatch batch(map, space, streams, true);
+Random actionRng(1);
+std::vector<int> actions(numberEnvironments);
+std::vector<float> rewards;
+std::vector<float> s;
+unsigned episodes = 0;
+for (unsigned t = 0; passed && t < numberSteps; t++) {
+    for (unsigned i = 0; i < numberEnvironments; i++) {
+        actions[i] = randomAction(actionRng);
+    }
+    batch.apply(actions, rewards);
+
+    for (unsigned i = 0; i < numberEnvironments; i++) {
+        ContinuousRooms& env = *envs[i];
+        float reward = env.apply(actions[i]);
+
+        bool same = rewards[i] == reward && bool(batch.terminated[i]) == env.terminal();
+        if (env.terminal()) {
+            env.reset();
+            episodes++;
+        }
+
+        batch.sensation(i, s);
+        const std::vector<float>& expected = env.sensation();
+        for (unsigned k = 0; k < s.size(); k++) {
+            same &= std::fabs(s[k] - expected[k]) < 1e-4;
+        }
+        if (passed && !same) {
+            std::cout << "FAILED: robot " << i << " of the batch diverges from ContinuousRooms at step " << t << std::endl;
+            passed = false;
+        }
+    }
+}
+if (passed) {
+    std::cout << "The batch and " << numberEnvironments << " ContinuousRooms agree over " << numberSteps << " steps and " << episodes << " episodes" << std::endl;
+}
+for (unsigned i = 0; i < numberEnvironments; i++) {
+    delete envs[i];
+}
+
+// Throughput of a large batch
+const unsigned numberRobots = 1024;
+ContinuousRoomsBatch robots(map, space, numberRobots, true, Random(3));
+std::vector<std::vector<int> > plans(16, std::vector<int>(numberRobots));
+for (unsigned p = 0; p < plans.size(); p++) {
+    for (unsigned i = 0; i < numberRobots; i++) {
+        plans[p][i] = randomAction(actionRng);
+    }
+}
+
+const unsigned numberBatches = 2000;
+auto start = std::chrono::steady_clock::now();
+for (unsigned t = 0; t < numberBatches; t++) {
+    robots.apply(plans[t % plans.size()], rewards);
+}
+double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+std::cout << "ContinuousRoomsBatch of " << numberRobots << " robots: " << numberBatches*numberRobots/seconds << " steps per second" << std::endl;
+
+if (!passed) {
+    return 1;
+}
+return 0;
+}
@@ -0,0 +1,62 @@
+#include <linear_options/LSTDOptionModelLearner.hh>
+
+#include <rl_common/Random.h>
+#include <stdexcept>
+#include <iostream>
+
+/**
+ * Random sparse features, as emitted by the RBF abstractions
+ */
+rl::sparse_features randomFeatures(Random& rng, int n, int active)
+{
+    rl::sparse_features phi(n);
+    for (int k = 0; k < active; k++) {
+        phi.push_back(rng.uniformDiscrete(0, n - 1), rng.uniform());
+    }
+    return phi;
+}
+
+int main(void)
+{
+const int n = 30;
+const double gamma = 0.9;
+Random rng(1);
+
+rl::LinearOptionModel model;
+model.F = 1e-2*Eigen::MatrixXd::Random(n, n);
+model.b = Eigen::VectorXd::Random(n);
+
+bool passed = true;
+
+// Solving needs the transitions
+rl::LSTDOptionModelLearner unrecorded(model, gamma, 1e-2);
+try {
+    unrecorded.solve(model);
+    std::cout << "FAILED: solve() without recording did not throw" << std::endl;
+    passed = false;
+} catch (const std::logic_error&) {
+}
+
+// The incremental estimate is exact after every step, so it must match the batch solution
+rl::LSTDOptionModelLearner learner(model, gamma, 1e-2, true);
+rl::sparse_features phi = randomFeatures(rng, n, 5);
+for (int t = 0; t < 200; t++) {
+    rl::sparse_features phiPrime = randomFeatures(rng, n, 5);
+    learner.update(model, phi, rng.uniform() - 0.5, phiPrime, rng.uniform());
+    phi = phiPrime;
+}
+
+rl::LinearOptionModel solved = model;
+learner.solve(solved);
+
+double errorF = (solved.F - model.F).cwiseAbs().maxCoeff();
+double errorB = (solved.b - model.b).cwiseAbs().maxCoeff();
+std::cout << "Largest difference between the incremental and solved models: F " << errorF << ", b " << errorB << std::endl;
+passed &= errorF < 1e-6 && errorB < 1e-6;
+
+if (!passed) {
+    std::cout << "FAILED: the least-squares models disagree" << std::endl;
+    return 1;
+}
+return 0;
+}
@@ -0,0 +1,106 @@
+#include <linear_options/RoomAbstraction.hh>
+#include <linear_options/CompactAbstraction.hh>
+
+#include <rl_common/Random.h>
+#include <cmath>
+#include <iostream>
+
+/**
+ * Emits every active feature of another abstraction twice, with half its
+ * value, as sparse_features allow repeated indices which add up
+ */
+struct repeated_abstraction : public rl::sparse_state_abstraction
+{
+    repeated_abstraction(rl::sparse_state_abstraction& abstraction) : abstraction(abstraction) {};
+
+    void project(const Eigen::VectorXd& s, rl::sparse_features& phi)
+    {
+        abstraction.project(s, phi);
+        const unsigned n = phi.indices.size();
+        for (unsigned k = 0; k < n; k++) {
+            phi.values[k] /= 2;
+            phi.push_back(phi.indices[k], phi.values[k]);
+        }
+    }
+
+    int length() { return abstraction.length(); }
+
+    rl::sparse_state_abstraction& abstraction;
+};
+
+/**
+ * Compare the batch projection of an abstraction with its projection of
+ * every state. The batch projections work in single precision, so the
+ * activations may differ by the documented relative tolerance, and an
+ * activation right at the cutoff may be dropped by either.
+ * @return True if the projections match
+ */
+bool matches(const std::string& name, rl::sparse_state_abstraction& abstraction, const Eigen::MatrixXd& states, double tolerance = 1e-6)
+{
+    Eigen::MatrixXd batch;
+    abstraction.projectBatch(states, batch);
+
+    rl::sparse_features active;
+    Eigen::VectorXd phi;
+    double largestError = 0;
+    bool passed = batch.rows() == abstraction.length() && batch.cols() == states.cols();
+    for (int i = 0; passed && i < states.cols(); i++) {
+        abstraction.project(states.col(i), active);
+        active.toDense(phi);
+        for (int j = 0; j < phi.size(); j++) {
+            double error = std::fabs(batch(j, i) - phi(j));
+            if (batch(j, i) == 0 || phi(j) == 0) {
+                // Only an activation at the cutoff may be missing
+                passed &= error < 1e-6 || std::fabs(error - rl::room_abstraction::CUTOFF) < 1e-5;
+            } else {
+                error /= std::fabs(phi(j));
+                largestError = std::max(largestError, error);
+            }
+        }
+    }
+    passed &= largestError < tolerance;
+
+    std::cout << name << ": largest relative error " << largestError << (passed ? "" : " FAILED") << std::endl;
+    return passed;
+}
+
+int main(void)
+{
+// States in the layout of ContinuousRooms::sensation
+Random rng(1);
+Eigen::MatrixXd states = Eigen::MatrixXd::Zero(7, 500);
+for (int i = 0; i < states.cols(); i++) {
+    states(rng.uniformDiscrete(0, 3), i) = 1;
+    states(4, i) = rng.uniform()*200;
+    states(5, i) = rng.uniform()*200;
+    states(6, i) = rng.uniformDiscrete(0, 11)*30;
+}
+
+// The heading is ignored as in the rooms basis, so that the compaction merges features
+Eigen::Vector3d C(1.0/10.2, 1.0/10.2, 1/30);
+rl::grid_axis xyAxis(10.2/2.0, 10, 20);
+rl::grid_axis psiAxis(0, 30, 13);
+
+bool passed = true;
+
+rl::room_abstraction rooms(rl::roomCenters(), C, 20);
+passed &= matches("room_abstraction", rooms, states, 2e-6);
+
+rl::grid_rbf_abstraction grid(xyAxis, xyAxis, psiAxis, C, 20);
+passed &= matches("grid_rbf_abstraction", grid, states);
+
+rl::compact_abstraction compact(grid, states, 4);
+passed &= matches("compact_abstraction", compact, states);
+
+repeated_abstraction repeated(compact);
+passed &= matches("repeated features", repeated, states);
+
+rl::tile_coding_abstraction tiles(Eigen::Vector2d(0, 0), Eigen::Vector2d(200, 200), Eigen::Vector3d(10, 10, M_PI/6.0), 8);
+passed &= matches("tile_coding_abstraction", tiles, states);
+
+if (!passed) {
+    std::cout << "FAILED: the batch projection differs from project()" << std::endl;
+    return 1;
+}
+return 0;
+}
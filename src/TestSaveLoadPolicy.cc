@@ -1,69 +1,95 @@
 #include <linear_options/LinearQ0Learner.hh>
-#include <linear_options/StateAbstraction.hh>
+#include <linear_options/DynaLOEMAgent.hh>
+#include <linear_options/RoomAbstraction.hh>
 #include <linear_options/ContinuousRooms.hh>
+#include <linear_options/BinaryArchive.hh>
 
-struct room_abstraction : public rl::state_abstraction
+#include <cstdio>
+#include <stdexcept>
+#include <iostream>
+
+int main(void)
 {
-    /**
-     * @param U The mean of the RBF
-     * @param C
-     * @param b
-     */
-    room_abstraction(Eigen::MatrixXd U, Eigen::Vector3d C, double b) :
-       b(b), U(U), C(C.asDiagonal()) {};
+Eigen::Vector3d C(1.0/10.2, 1.0/10.2, 1/30);
+rl::room_abstraction stateAbstraction(rl::roomCenters(), C, 20);
+rl::LinearQ0Learner agent(ContinuousRooms::NUM_ACTIONS, 5e-4, 0.1, 0.9, stateAbstraction);
 
-    /**
-     * @param s Project the input vector in the n-d space
-     */
-    Eigen::VectorXd operator()(const Eigen::VectorXd& s) {
-        Eigen::VectorXd phi(length());
-        // The first 4 elements are binary indicator variables for floor color
-        phi(0) = s[0];
-        phi(1) = s[1];
-        phi(2) = s[2];
-        phi(3) = s[3];
+agent.loadPolicy("agent1.rl");
+agent.savePolicy("agent11.rl");
 
-        // The next 3 elements: x, y, psi
-        for (int i = 0; i < U.rows(); i++) {
-            phi(i + 4) = b*exp(-0.5*(s.tail(U.cols()) - U.row(i).transpose()).dot(C*(s.tail(U.cols()) - U.row(i).transpose()))); 
-            if (phi(i + 4) < 0.1) { 
-                phi(i + 4) = 0;
-            }
-        }
+// Round trip through the binary format: agent12.rl must be identical to agent11.rl
+agent.saveBinaryPolicy("agent1.bin");
+rl::LinearQ0Learner binaryAgent(ContinuousRooms::NUM_ACTIONS, 5e-4, 0.1, 0.9, stateAbstraction);
+binaryAgent.loadPolicy("agent1.bin");
+binaryAgent.savePolicy("agent12.rl");
 
-        return phi;
-    }
+// Archives which cannot be written or do not fit the agent are rejected
+bool passed = true;
+try {
+    agent.saveBinaryPolicy("no_such_directory/agent1.bin");
+    std::cout << "FAILED: a policy was saved to a missing directory" << std::endl;
+    passed = false;
+} catch (const std::runtime_error&) {
+}
 
-    int length() { return U.rows() + 4; }
+rl::LinearQ0Learner otherActions(ContinuousRooms::NUM_ACTIONS + 1, 5e-4, 0.1, 0.9, stateAbstraction);
+try {
+    otherActions.loadPolicy("agent1.bin");
+    std::cout << "FAILED: a policy over other actions was loaded" << std::endl;
+    passed = false;
+} catch (const std::runtime_error&) {
+}
 
-private:
-    double b;
-    Eigen::MatrixXd U;
-    Eigen::DiagonalMatrix<double, 3, 3> C;
-};
+// An options archive holds a policy and a value function per option
+std::vector<Eigen::MatrixXd> storage;
+storage.push_back(Eigen::MatrixXd::Zero(stateAbstraction.length(), ContinuousRooms::NUM_ACTIONS));
+storage.push_back(Eigen::MatrixXd::Zero(stateAbstraction.length(), 1));
+storage.push_back(Eigen::MatrixXd::Zero(stateAbstraction.length(), ContinuousRooms::NUM_ACTIONS));
+std::vector<rl::binary_array> unpaired;
+for (unsigned i = 0; i < storage.size(); i++) {
+    unpaired.push_back(rl::binary_array(storage[i]));
+}
+rl::saveBinary("unpaired_options.bin", rl::BINARY_OPTIONS, unpaired);
+try {
+    rl::DynaLOEMAgent agentWithUnpairedOptions(ContinuousRooms::NUM_ACTIONS, 1e-3, 0.1, 0.9, stateAbstraction, "unpaired_options.bin", "");
+    std::cout << "FAILED: an options archive with an unpaired array was loaded" << std::endl;
+    passed = false;
+} catch (const std::runtime_error&) {
+}
+std::remove("unpaired_options.bin");
 
-int main(void)
-{
-// Radial-basis functions are placed every 10 units in 
-// in the x and y dimensions and every 30 degrees
-Eigen::MatrixXd U(5200, 3);
-int i = 0;
-for (double x = 10.2/2.0; x < 200; x += 10) {
-    for (double y = 10.2/2.0; y < 200; y += 10) {
-        for (double psi = 0; psi <= 360; psi += 30) {
-            U(i, 0) = x;
-            U(i, 1) = y;
-            U(i, 2) = psi;
-            i += 1;
-        }
-    }
+// The value function of an option must be over the features of its policy
+std::vector<rl::binary_array> mismatched(1, rl::binary_array(storage[0]));
+Eigen::VectorXd shortTheta = Eigen::VectorXd::Zero(stateAbstraction.length() - 1);
+mismatched.push_back(rl::binary_array(shortTheta));
+rl::saveBinary("mismatched_options.bin", rl::BINARY_OPTIONS, mismatched);
+try {
+    rl::DynaLOEMAgent agentWithMismatchedOptions(ContinuousRooms::NUM_ACTIONS, 1e-3, 0.1, 0.9, stateAbstraction, "mismatched_options.bin", "");
+    std::cout << "FAILED: an options archive with a value function over other features was loaded" << std::endl;
+    passed = false;
+} catch (const std::runtime_error&) {
 }
-Eigen::Vector3d C(1.0/10.2, 1.0/10.2, 1/30);
-room_abstraction stateAbstraction(U, C, 20);
-rl::LinearQ0Learner agent(ContinuousRooms::NUM_ACTIONS, 5e-4, 0.1, 0.9, stateAbstraction);
+std::remove("mismatched_options.bin");
 
-agent.loadPolicy("agent1.rl");
-agent.savePolicy("agent11.rl");
+// Sizes in a corrupted table of entries must not overflow past the checks
+rl::saveBinary("corrupted_policy.bin", rl::BINARY_POLICY, std::vector<rl::binary_array>(1, rl::binary_array(storage[0])));
+{
+    std::FILE* file = std::fopen("corrupted_policy.bin", "r+b");
+    rl::binary_entry entry;
+    std::fseek(file, sizeof(rl::binary_header), SEEK_SET);
+    std::fread(&entry, sizeof(entry), 1, file);
+    entry.rows = uint64_t(1) << 62;
+    std::fseek(file, sizeof(rl::binary_header), SEEK_SET);
+    std::fwrite(&entry, sizeof(entry), 1, file);
+    std::fclose(file);
+}
+try {
+    rl::MappedArchive corrupted("corrupted_policy.bin");
+    std::cout << "FAILED: an archive with an array larger than the file was mapped" << std::endl;
+    passed = false;
+} catch (const std::runtime_error&) {
+}
+std::remove("corrupted_policy.bin");
 
-return 0;
+return passed ? 0 : 1;
 }
@@ -0,0 +1,72 @@
+#include <linear_options/TrajectoryRenderer.hh>
+
+#include <opencv/highgui.h>
+#include <sstream>
+
+TrajectoryRenderer::TrajectoryRenderer(const cv::Mat& background, const std::string& filenamePrefix, unsigned every, unsigned capacity) :
+    background(background),
+    filenamePrefix(filenamePrefix),
+    every(every),
+    capacity(capacity),
+    done(false),
+    worker(&TrajectoryRenderer::run, this)
+{
+}
+
+TrajectoryRenderer::~TrajectoryRenderer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    available.notify_one();
+    worker.join();
+}
+
+bool TrajectoryRenderer::push(unsigned episode, std::vector<cv::Point>& trajectory)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queue.size() >= capacity) {
+            trajectory.clear();
+            return false;
+        }
+
+        queue.push_back(Episode());
+        queue.back().index = episode;
+        queue.back().trajectory.swap(trajectory);
+    }
+    available.notify_one();
+
+    trajectory.clear();
+    return true;
+}
+
+void TrajectoryRenderer::run()
+{
+    while (true) {
+        Episode episode;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (queue.empty() && !done) {
+                available.wait(lock);
+            }
+            if (queue.empty()) {
+                return;
+            }
+
+            episode.index = queue.front().index;
+            episode.trajectory.swap(queue.front().trajectory);
+            queue.pop_front();
+        }
+
+        cv::Mat img = background.clone();
+        for (auto it = episode.trajectory.begin(); it != episode.trajectory.end(); it++) {
+            cv::circle(img, *it, 5, cv::Scalar(0, 0, 0), 1); 
+        }
+
+        std::stringstream ss;
+        ss << filenamePrefix << episode.index << ".png";
+        cv::imwrite(ss.str(), img);
+    }
+}